@@ -0,0 +1,461 @@
+#include "QLog.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#  include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#  include <x86intrin.h>
+#endif
+
+#if !defined(QLOG_VERSION)
+#  define QLOG_VERSION "unknown"
+#endif
+
+// Measures QLog's caller-side latency, producer scaling, filtered-call cost and
+// per-sink output rates, and writes the numbers to a JSON file for tracking
+// across versions:
+//   QLogBench [--quick] [--threads N] [--out results.json]
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    // Cycle counter for per-call latency; steady_clock where there is none
+    inline std::uint64_t Ticks()
+    {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+        return __rdtsc();
+#elif defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#elif defined(__aarch64__)
+        std::uint64_t value;
+        __asm__ __volatile__("isb; mrs %0, cntvct_el0" : "=r"(value));
+        return value;
+#else
+        return static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count());
+#endif
+    }
+
+    double MeasureNsPerTick()
+    {
+        const std::uint64_t t0 = Ticks();
+        const auto c0 = Clock::now();
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        const std::uint64_t t1 = Ticks();
+        const auto c1 = Clock::now();
+        return std::chrono::duration<double, std::nano>(c1 - c0).count() / static_cast<double>(t1 - t0);
+    }
+
+    double Seconds(Clock::time_point from, Clock::time_point to)
+    {
+        return std::chrono::duration<double>(to - from).count();
+    }
+
+    struct Config
+    {
+        size_t latencySamples{200000};
+        size_t throughputRecords{2000000};
+        size_t filteredCalls{20000000};
+        size_t sinkRecords{500000};
+        size_t maxThreads{std::max(1u, std::min(8u, std::thread::hardware_concurrency()))};
+        std::string out{"qlog_bench.json"};
+    };
+
+    // Collects results, echoing each one as it arrives
+    class Report
+    {
+    public:
+        void Add(const std::string& benchmark, const char* metric, double value, const char* unit)
+        {
+            std::printf("%-36s %-14s %14.1f %s\n", benchmark.c_str(), metric, value, unit);
+            std::fflush(stdout);
+            m_results.push_back(Result{benchmark, metric, value, unit});
+        }
+
+        bool WriteJson(const std::string& path, const Config& config, double nsPerTick) const
+        {
+            std::ofstream out(path, std::ios::trunc);
+            if (!out)
+            {
+                return false;
+            }
+            const auto now = std::chrono::duration_cast<std::chrono::seconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+            out << "{\n  \"qlog_version\": \"" << QLOG_VERSION << "\",\n"
+                << "  \"unix_time\": " << now << ",\n"
+                << "  \"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n"
+                << "  \"max_producer_threads\": " << config.maxThreads << ",\n"
+                << "  \"ns_per_tick\": " << nsPerTick << ",\n"
+                << "  \"results\": [\n";
+            for (size_t i = 0; i < m_results.size(); ++i)
+            {
+                const Result& r = m_results[i];
+                out << "    {\"benchmark\": \"" << r.benchmark << "\", \"metric\": \"" << r.metric
+                    << "\", \"value\": " << r.value << ", \"unit\": \"" << r.unit << "\"}"
+                    << (i + 1 < m_results.size() ? ",\n" : "\n");
+            }
+            out << "  ]\n}\n";
+            return static_cast<bool>(out);
+        }
+
+    private:
+        struct Result
+        {
+            std::string benchmark;
+            std::string metric;
+            double value;
+            std::string unit;
+        };
+        std::vector<Result> m_results;
+    };
+
+    // std::ostream target that only counts, so OStreamSink is measured without a terminal
+    class CountingBuf : public std::streambuf
+    {
+    public:
+        std::uint64_t Bytes() const { return m_bytes; }
+
+    protected:
+        std::streamsize xsputn(const char*, std::streamsize n) override
+        {
+            m_bytes += static_cast<std::uint64_t>(n);
+            return n;
+        }
+        int_type overflow(int_type ch) override
+        {
+            ++m_bytes;
+            return traits_type::not_eof(ch);
+        }
+
+    private:
+        std::uint64_t m_bytes{0};
+    };
+
+    const char* QueueModeName(QLog::QueueMode mode)
+    {
+        switch (mode)
+        {
+            case QLog::QueueMode::LockFree: return "lockfree";
+            case QLog::QueueMode::PerThread: return "perthread";
+            default: return "locked";
+        }
+    }
+
+    constexpr QLog::QueueMode kQueueModes[] = {QLog::QueueMode::Locked, QLog::QueueMode::LockFree,
+                                               QLog::QueueMode::PerThread};
+
+    void ReportPercentiles(Report& report, const std::string& name, std::vector<std::uint64_t>& ticks,
+                           double nsPerTick)
+    {
+        std::sort(ticks.begin(), ticks.end());
+        auto at = [&](double q)
+        {
+            return static_cast<double>(ticks[static_cast<size_t>(q * static_cast<double>(ticks.size() - 1))]) *
+                   nsPerTick;
+        };
+        report.Add(name, "p50", at(0.50), "ns");
+        report.Add(name, "p99", at(0.99), "ns");
+        report.Add(name, "p99.9", at(0.999), "ns");
+    }
+
+    // Time spent inside the logging call on the producer, sampled per call
+    void BenchLatency(Report& report, const Config& config, double nsPerTick)
+    {
+        for (QLog::QueueMode mode : kQueueModes)
+        {
+            for (bool deferred : {false, true})
+            {
+                QLog::NullSink sink;
+                QLog::LoggerOptions options;
+                options.queueMode = mode;
+                options.capacity = 1 << 16;
+                QLog::Logger logger{sink, options};
+                std::vector<std::uint64_t> ticks(config.latencySamples);
+                for (size_t i = 0; i < 1000; ++i)
+                {
+                    logger.Info("warmup %zu", i);
+                }
+                logger.Flush();
+                for (size_t i = 0; i < ticks.size(); ++i)
+                {
+                    const std::uint64_t t0 = Ticks();
+                    if (deferred)
+                    {
+                        logger.LogDeferred(QLog::Level::Info, "request %d took %.3f ms from %s",
+                                           static_cast<int>(i), 1.5, "10.0.0.1");
+                    }
+                    else
+                    {
+                        logger.Info("request %d took %.3f ms from %s", static_cast<int>(i), 1.5, "10.0.0.1");
+                    }
+                    ticks[i] = Ticks() - t0;
+                }
+                logger.Flush();
+                const std::string name = std::string("latency/") + QueueModeName(mode) +
+                                         (deferred ? "/deferred" : "/printf");
+                ReportPercentiles(report, name, ticks, nsPerTick);
+                report.Add(name, "dropped", static_cast<double>(logger.GetStats().dropped), "records");
+            }
+        }
+    }
+
+    // Records per second from N producers to a NullSink; Block keeps every
+    // record, so this is what the worker sustains end to end
+    void BenchThroughput(Report& report, const Config& config)
+    {
+        for (QLog::QueueMode mode : kQueueModes)
+        {
+            for (size_t threads = 1; threads <= config.maxThreads; threads *= 2)
+            {
+                QLog::NullSink sink;
+                QLog::LoggerOptions options;
+                options.queueMode = mode;
+                options.capacity = 1 << 14;
+                options.backpressure = QLog::Backpressure::Block;
+                QLog::Logger logger{sink, options};
+                const size_t perThread = config.throughputRecords / threads;
+                std::atomic<bool> go{false};
+                std::vector<std::thread> producers;
+                for (size_t t = 0; t < threads; ++t)
+                {
+                    producers.emplace_back([&, t]
+                    {
+                        while (!go.load(std::memory_order_acquire))
+                        {
+                            std::this_thread::yield();
+                        }
+                        for (size_t i = 0; i < perThread; ++i)
+                        {
+                            logger.Info("thread %zu record %zu", t, i);
+                        }
+                    });
+                }
+                const auto start = Clock::now();
+                go.store(true, std::memory_order_release);
+                for (auto& producer : producers)
+                {
+                    producer.join();
+                }
+                logger.Flush();
+                const double elapsed = Seconds(start, Clock::now());
+                const std::string name = std::string("throughput/") + QueueModeName(mode) + "/" +
+                                         std::to_string(threads) + "t";
+                report.Add(name, "records_per_s", static_cast<double>(perThread * threads) / elapsed, "records/s");
+            }
+        }
+    }
+
+    // Cost of a call whose level is filtered out, through the method and the macro
+    void BenchFiltered(Report& report, const Config& config, double nsPerTick)
+    {
+        QLog::NullSink sink;
+        QLog::Logger logger{sink, QLog::Level::Warn};
+        std::uint64_t t0 = Ticks();
+        for (size_t i = 0; i < config.filteredCalls; ++i)
+        {
+            logger.Debug("filtered %zu", i);
+        }
+        const double method = static_cast<double>(Ticks() - t0) * nsPerTick / static_cast<double>(config.filteredCalls);
+        t0 = Ticks();
+        for (size_t i = 0; i < config.filteredCalls; ++i)
+        {
+            QLOG_DEBUG(logger, "filtered %zu", i);
+        }
+        const double macro = static_cast<double>(Ticks() - t0) * nsPerTick / static_cast<double>(config.filteredCalls);
+        report.Add("filtered/method", "per_call", method, "ns");
+        report.Add("filtered/macro", "per_call", macro, "ns");
+    }
+
+    // Drives `count` records through one sink; returns elapsed seconds
+    template <typename Fn>
+    double DriveSink(QLog::Sink& sink, size_t count, bool deferred, Fn&& after)
+    {
+        QLog::LoggerOptions options;
+        options.queueMode = QLog::QueueMode::LockFree;
+        options.capacity = 1 << 14;
+        options.backpressure = QLog::Backpressure::Block;
+        const auto start = Clock::now();
+        {
+            QLog::Logger logger{sink, options};
+            for (size_t i = 0; i < count; ++i)
+            {
+                if (deferred)
+                {
+                    logger.LogDeferred(QLog::Level::Info, "GET /api/items/%zu -> %d in %.2f ms", i, 200, 0.25);
+                }
+                else
+                {
+                    logger.Info("GET /api/items/%zu -> %d in %.2f ms", i, 200, 0.25);
+                }
+            }
+            logger.Flush();
+            after();
+        }
+        return Seconds(start, Clock::now());
+    }
+
+    std::uint64_t FileBytes(const std::filesystem::path& path)
+    {
+        std::error_code ec;
+        const auto size = std::filesystem::file_size(path, ec);
+        return ec ? 0 : static_cast<std::uint64_t>(size);
+    }
+
+    // Output rate of each sink type, with NullSink as the baseline
+    void BenchSinks(Report& report, const Config& config, const std::filesystem::path& dir)
+    {
+        const size_t n = config.sinkRecords;
+        auto add = [&](const char* sink, double elapsed, std::uint64_t bytes)
+        {
+            const std::string name = std::string("sink/") + sink;
+            report.Add(name, "records_per_s", static_cast<double>(n) / elapsed, "records/s");
+            if (bytes != 0)
+            {
+                report.Add(name, "bytes_per_s", static_cast<double>(bytes) / elapsed, "bytes/s");
+            }
+        };
+
+        {
+            QLog::NullSink sink;
+            const double elapsed = DriveSink(sink, n, false, [] {});
+            add("null", elapsed, 0);
+        }
+        {
+            QLog::MemoryRingSink sink(4096);
+            const double elapsed = DriveSink(sink, n, false, [] {});
+            add("memory_ring", elapsed, 0);
+        }
+        {
+            CountingBuf buf;
+            std::ostream os(&buf);
+            QLog::OStreamSink sink(os);
+            const double elapsed = DriveSink(sink, n, false, [] {});
+            add("ostream", elapsed, buf.Bytes());
+        }
+        for (QLog::FileIo io : {QLog::FileIo::Sync, QLog::FileIo::Async})
+        {
+            const auto path = dir / "file.log";
+            std::uint64_t bytes = 0;
+            double elapsed;
+            {
+                QLog::FileSink sink(path.string(), QLog::kDefaultFileBufferSize, true, io);
+                elapsed = DriveSink(sink, n, false, [&] { bytes = FileBytes(path); });
+            }
+            add(io == QLog::FileIo::Sync ? "file" : "file_async", elapsed, bytes);
+            std::filesystem::remove(path);
+        }
+        {
+            QLog::RotationOptions rotation;
+            rotation.maxBytes = 16ull << 20;
+            const auto base = dir / "rotating.log";
+            std::uint64_t bytes = 0;
+            double elapsed;
+            {
+                QLog::RotatingFileSink sink(base.string(), rotation);
+                elapsed = DriveSink(sink, n, false, [&]
+                {
+                    for (const auto& entry : std::filesystem::directory_iterator(dir))
+                    {
+                        if (entry.path().filename().string().rfind("rotating.log", 0) == 0)
+                        {
+                            bytes += FileBytes(entry.path());
+                        }
+                    }
+                });
+            }
+            add("rotating", elapsed, bytes);
+        }
+        {
+            const auto path = dir / "ring.qlr";
+            QLog::MappedRingFileSink sink(path.string());
+            const double elapsed = DriveSink(sink, n, false, [] {});
+            add("mapped_ring", elapsed, 0); // a fixed-size ring: its file size says nothing
+        }
+        {
+            const auto path = dir / "binary.qlb";
+            std::uint64_t bytes = 0;
+            double elapsed;
+            {
+                std::ofstream out(path, std::ios::binary | std::ios::trunc);
+                QLog::BinarySink sink(out);
+                elapsed = DriveSink(sink, n, true, [&]
+                {
+                    out.flush();
+                    bytes = FileBytes(path);
+                });
+            }
+            add("binary", elapsed, bytes);
+        }
+    }
+
+    bool ParseArgs(int argc, char** argv, Config& config)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            if (std::strcmp(argv[i], "--quick") == 0)
+            {
+                config.latencySamples /= 20;
+                config.throughputRecords /= 20;
+                config.filteredCalls /= 20;
+                config.sinkRecords /= 20;
+            }
+            else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            {
+                config.maxThreads = std::max<size_t>(1, std::strtoul(argv[++i], nullptr, 10));
+            }
+            else if (std::strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+            {
+                config.out = argv[++i];
+            }
+            else
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Config config;
+    if (!ParseArgs(argc, argv, config))
+    {
+        std::fprintf(stderr, "usage: %s [--quick] [--threads N] [--out results.json]\n", argv[0]);
+        return 2;
+    }
+
+    const auto dir = std::filesystem::temp_directory_path() /
+                     ("qlog_bench_" + std::to_string(Clock::now().time_since_epoch().count()));
+    std::filesystem::create_directories(dir);
+
+    const double nsPerTick = MeasureNsPerTick();
+    Report report;
+    BenchLatency(report, config, nsPerTick);
+    BenchThroughput(report, config);
+    BenchFiltered(report, config, nsPerTick);
+    BenchSinks(report, config, dir);
+
+    std::error_code ec;
+    std::filesystem::remove_all(dir, ec);
+    if (!report.WriteJson(config.out, config, nsPerTick))
+    {
+        std::fprintf(stderr, "%s: cannot write %s\n", argv[0], config.out.c_str());
+        return 1;
+    }
+    std::printf("results written to %s\n", config.out.c_str());
+    return 0;
+}
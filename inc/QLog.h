@@ -1,12 +1,15 @@
 #pragma once
 
+#include <array>
 #include <atomic>
 #include <condition_variable>
 #include <chrono>
 #include <cstdint>
 #include <cstdarg>
+#include <cstring>
 #include <functional>
 #include <iosfwd>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <optional>
@@ -15,9 +18,18 @@
 #include <string>
 #include <string_view>
 #include <thread>
+#include <tuple>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
+// Lets GCC/Clang type-check printf-style calls (-Wformat); indices count `this` as 1
+#if defined(__GNUC__) || defined(__clang__)
+#  define QLOG_PRINTF_LIKE(formatIndex, firstArg) __attribute__((format(printf, formatIndex, firstArg)))
+#else
+#  define QLOG_PRINTF_LIKE(formatIndex, firstArg)
+#endif
+
 namespace QLog
 {
 
@@ -36,8 +48,9 @@ enum class Level : std::uint8_t
 // How Logger triggers a break when threshold is met
 enum class BreakMode : std::uint8_t
 {
-    DebugBreak, // trigger debugger break (__debugbreak/__builtin_trap)
-    Throw       // throw an exception (test-friendly)
+    DebugBreak, // trigger debugger break (__debugbreak/__builtin_trap) once the
+                // record, and everything before it, reached the sinks
+    Throw       // throw an exception (test-friendly) instead of logging the record
 };
 
 // Exception thrown when BreakMode::Throw is active and a break is triggered
@@ -46,17 +59,49 @@ struct BreakException : public std::exception
     const char* what() const noexcept override { return "QLog break triggered"; }
 };
 
-// Simple log message structure
+// Queue used to hand messages from producer threads to the background worker
+enum class QueueMode : std::uint8_t
+{
+    Locked,   // mutex-guarded std::deque (supports unbounded capacity)
+    LockFree, // bounded lock-free ring of preallocated record slots
+    PerThread // one single-producer ring per thread, merged by timestamp on the worker
+};
+
+// Where message timestamps come from
+enum class ClockSource : std::uint8_t
+{
+    System, // std::chrono::system_clock::now() on the calling thread
+    Steady, // steady_clock ticks captured by the caller, converted to wall time on the worker
+    Tsc     // raw rdtsc/cntvct counter, calibrated against system_clock on the worker
+            // (falls back to steady_clock ticks on other architectures)
+};
+
+// Formats a deferred record's encoded arguments with snprintf semantics:
+// writes at most `size` bytes to `out` and returns the full length needed
+using RenderFn = int (*)(const char* format, const void* args, char* out, size_t size);
+
+namespace Detail
+{
+    struct ArgSignature;
+}
+
+// Simple log message structure. The worker builds these per batch from the
+// packed records producers queue; they are only valid during Sink::Write.
 struct Message
 {
     Level level{};
     std::optional<std::chrono::system_clock::time_point> timestamp; // present if timestamps enabled
     // Text is a non-owning view into memory managed by Logger's internal pool
     std::string_view text{};
-    // Storage metadata for releasing memory after sink write
-    void* storage{nullptr};
-    size_t storageSize{0};
-    bool storagePooled{false};
+    // Deferred records (Logger::LogDeferred) carry the format string and the
+    // encoded arguments instead of text until they are rendered
+    const char* format{nullptr};
+    const void* args{nullptr};
+    RenderFn render{nullptr};
+    // Byte layout of `args` (Detail::ArgSignature), for sinks that store them raw
+    const Detail::ArgSignature* signature{nullptr};
+
+    bool IsDeferred() const { return render != nullptr; }
 };
 
 // Abstract sink interface (console, file, custom)
@@ -65,82 +110,1084 @@ class Sink
 public:
     virtual ~Sink() = default;
     virtual void Write(const Message& message) = 0;
+    // Receives every message the worker drained in one step, in order;
+    // override to coalesce output (e.g. one write call per batch)
+    virtual void WriteBatch(const Message* messages, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            Write(messages[i]);
+        }
+    }
     virtual void Flush() {}
+    // Sinks that return true receive deferred records unrendered (text empty);
+    // otherwise the worker renders them into text before Write
+    virtual bool AcceptsDeferred() const { return false; }
+};
+
+// Renders a deferred record into `buffer` and returns a view of the text.
+// Non-deferred records return their text unchanged.
+std::string_view RenderText(const Message& message, std::string& buffer);
+
+namespace Detail
+{
+    // printf into a buffer; lets templates forward decoded arguments without
+    // handing a non-literal format to snprintf directly
+    int FormatInto(char* out, size_t size, const char* format, ...);
+
+    // Argument class as seen by printf after default promotions:
+    // 'i' signed integer, 'u' unsigned integer, 'f' double, 'F' long double,
+    // 's' string, 'p' other pointer. `size` is the promoted size in bytes.
+    struct ArgType
+    {
+        char kind;
+        std::uint8_t size;
+    };
+
+    template <typename T>
+    constexpr ArgType ArgTypeOf()
+    {
+        if constexpr (std::is_same_v<T, const char*> || std::is_same_v<T, char*> ||
+                      std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>)
+        {
+            return ArgType{'s', static_cast<std::uint8_t>(sizeof(const char*))};
+        }
+        else if constexpr (std::is_pointer_v<T>)
+        {
+            return ArgType{'p', static_cast<std::uint8_t>(sizeof(void*))};
+        }
+        else if constexpr (std::is_same_v<T, long double>)
+        {
+            return ArgType{'F', static_cast<std::uint8_t>(sizeof(long double))};
+        }
+        else if constexpr (std::is_floating_point_v<T>)
+        {
+            return ArgType{'f', static_cast<std::uint8_t>(sizeof(double))};
+        }
+        else if constexpr (std::is_integral_v<T>)
+        {
+            constexpr size_t promoted = sizeof(T) < sizeof(int) ? sizeof(int) : sizeof(T);
+            return ArgType{std::is_signed_v<T> || sizeof(T) < sizeof(int) ? 'i' : 'u', static_cast<std::uint8_t>(promoted)};
+        }
+        else
+        {
+            return ArgType{'?', 0};
+        }
+    }
+
+    enum class FormatError : std::uint8_t
+    {
+        None,
+        TooFewArguments,
+        TooManyArguments,
+        TypeMismatch,
+        UnsupportedConversion
+    };
+
+    // Walks a printf format string at compile time and checks every conversion
+    // (including '*' width/precision) against the argument types
+    constexpr FormatError CheckFormat(const char* f, const ArgType* types, size_t count)
+    {
+        size_t next = 0;
+        auto isDigit = [](char c) { return c >= '0' && c <= '9'; };
+        auto isInteger = [](const ArgType& t) { return t.kind == 'i' || t.kind == 'u'; };
+        while (*f)
+        {
+            if (*f++ != '%')
+            {
+                continue;
+            }
+            if (*f == '%')
+            {
+                ++f;
+                continue;
+            }
+            while (*f == '-' || *f == '+' || *f == ' ' || *f == '#' || *f == '0')
+            {
+                ++f;
+            }
+            for (int part = 0; part < 2; ++part) // width, then precision
+            {
+                if (part == 1)
+                {
+                    if (*f != '.')
+                    {
+                        break;
+                    }
+                    ++f;
+                }
+                if (*f == '*')
+                {
+                    if (next >= count)
+                    {
+                        return FormatError::TooFewArguments;
+                    }
+                    if (!isInteger(types[next]) || types[next].size != sizeof(int))
+                    {
+                        return FormatError::TypeMismatch;
+                    }
+                    ++next;
+                    ++f;
+                }
+                while (isDigit(*f))
+                {
+                    ++f;
+                }
+            }
+
+            size_t intSize = sizeof(int);
+            bool longDouble = false;
+            switch (*f)
+            {
+                case 'h': ++f; if (*f == 'h') ++f; break;
+                case 'l': ++f; intSize = sizeof(long); if (*f == 'l') { ++f; intSize = sizeof(long long); } break;
+                case 'j': ++f; intSize = sizeof(std::intmax_t); break;
+                case 'z': ++f; intSize = sizeof(size_t); break;
+                case 't': ++f; intSize = sizeof(std::ptrdiff_t); break;
+                case 'L': ++f; longDouble = true; break;
+                default: break;
+            }
+
+            const char conv = *f;
+            if (conv == '\0')
+            {
+                return FormatError::UnsupportedConversion;
+            }
+            ++f;
+            if (next >= count)
+            {
+                return FormatError::TooFewArguments;
+            }
+            const ArgType t = types[next++];
+            switch (conv)
+            {
+                case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+                    if (!isInteger(t) || t.size != intSize) return FormatError::TypeMismatch;
+                    break;
+                case 'c':
+                    if (!isInteger(t) || t.size != sizeof(int)) return FormatError::TypeMismatch;
+                    break;
+                case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+                    if (t.kind != (longDouble ? 'F' : 'f')) return FormatError::TypeMismatch;
+                    break;
+                case 's':
+                    if (t.kind != 's') return FormatError::TypeMismatch;
+                    break;
+                case 'p':
+                    if (t.kind != 'p' && t.kind != 's') return FormatError::TypeMismatch;
+                    break;
+                default:
+                    return FormatError::UnsupportedConversion; // includes %n
+            }
+        }
+        return next == count ? FormatError::None : FormatError::TooManyArguments;
+    }
+
+    template <typename... Ts>
+    struct TypeList
+    {
+        static constexpr std::array<ArgType, sizeof...(Ts)> kTypes{ArgTypeOf<Ts>()...};
+
+        static constexpr FormatError Check(const char* format)
+        {
+            return CheckFormat(format, kTypes.data(), kTypes.size());
+        }
+    };
+
+    template <typename... Ts>
+    constexpr FormatError CheckFormatFor(const char* format)
+    {
+        return TypeList<std::decay_t<Ts>...>::Check(format);
+    }
+
+    // Never called; names the decayed argument types of a QLOG_DEFERRED call
+    template <typename... Args>
+    TypeList<std::decay_t<Args>...> ArgumentTypes(const char* format, const Args&... args);
+
+    // Encodes one argument of a deferred record into raw bytes and decodes it
+    // back into the type passed to printf. Scalars are copied verbatim.
+    template <typename T, typename Enable = void>
+    struct ArgCodec
+    {
+        static_assert(std::is_arithmetic_v<T> || std::is_pointer_v<T>,
+                      "LogDeferred arguments must be arithmetic, pointers or strings");
+        using Decoded = T;
+
+        static size_t Size(const T&) { return sizeof(T); }
+        static char* Encode(char* out, const T& value)
+        {
+            std::memcpy(out, &value, sizeof(T));
+            return out + sizeof(T);
+        }
+        static T Decode(const char*& in)
+        {
+            T value;
+            std::memcpy(&value, in, sizeof(T));
+            in += sizeof(T);
+            return value;
+        }
+    };
+
+    // Strings are copied (length-prefixed, NUL-terminated) since the caller's
+    // buffer may be gone by the time the worker renders; they decode to const char*
+    struct StringCodec
+    {
+        using Decoded = const char*;
+
+        static size_t Size(std::string_view value) { return sizeof(std::uint32_t) + value.size() + 1; }
+        static char* Encode(char* out, std::string_view value)
+        {
+            const auto len = static_cast<std::uint32_t>(value.size());
+            std::memcpy(out, &len, sizeof(len));
+            out += sizeof(len);
+            std::memcpy(out, value.data(), len);
+            out[len] = '\0';
+            return out + len + 1;
+        }
+        static const char* Decode(const char*& in)
+        {
+            std::uint32_t len;
+            std::memcpy(&len, in, sizeof(len));
+            const char* text = in + sizeof(len);
+            in = text + len + 1;
+            return text;
+        }
+    };
+
+    template <typename T>
+    struct ArgCodec<T, std::enable_if_t<std::is_same_v<T, const char*> || std::is_same_v<T, char*>>> : StringCodec
+    {
+        static size_t Size(const char* value) { return StringCodec::Size(value ? value : "(null)"); }
+        static char* Encode(char* out, const char* value) { return StringCodec::Encode(out, value ? value : "(null)"); }
+    };
+    template <>
+    struct ArgCodec<std::string> : StringCodec {};
+    template <>
+    struct ArgCodec<std::string_view> : StringCodec {};
+
+    template <typename... Ts>
+    int Render(const char* format, const void* args, char* out, size_t size)
+    {
+        const char* in = static_cast<const char*>(args);
+        // Braced initialization decodes left to right
+        std::tuple<typename ArgCodec<Ts>::Decoded...> decoded{ArgCodec<Ts>::Decode(in)...};
+        (void)in;
+        return std::apply([&](auto... values) { return FormatInto(out, size, format, values...); }, decoded);
+    }
+
+    // How an argument sits in a deferred record: the kind ArgTypeOf gives, but
+    // with the signedness and size of the stored, unpromoted value (0 for the
+    // length-prefixed strings)
+    template <typename T>
+    constexpr ArgType StoredArgTypeOf()
+    {
+        constexpr ArgType promoted = ArgTypeOf<T>();
+        if constexpr (promoted.kind == 's')
+        {
+            return ArgType{'s', 0};
+        }
+        else if constexpr (std::is_integral_v<T>)
+        {
+            return ArgType{std::is_signed_v<T> ? 'i' : 'u', static_cast<std::uint8_t>(sizeof(T))};
+        }
+        else
+        {
+            return ArgType{promoted.kind, static_cast<std::uint8_t>(sizeof(T))};
+        }
+    }
+
+    // One static instance per argument type list: renders the encoded arguments
+    // and describes their layout
+    struct ArgSignature
+    {
+        RenderFn render;
+        const ArgType* types;
+        size_t count;
+    };
+
+    template <typename... Ts>
+    struct Signature
+    {
+        static constexpr std::array<ArgType, sizeof...(Ts)> kTypes{StoredArgTypeOf<Ts>()...};
+        static constexpr ArgSignature kValue{&Render<Ts...>, kTypes.data(), sizeof...(Ts)};
+    };
+} // namespace Detail
+
+// Static per-call-site descriptor built by QLOG_DEFERRED: the format string has
+// been checked against the argument types at compile time and the render
+// function and argument signature are fixed, so logging only copies bytes
+struct CallSite
+{
+    const char* format;
+    const char* file;
+    int line;
+    RenderFn render;
+    const Detail::ArgType* argTypes;
+    size_t argCount;
+    const Detail::ArgSignature* signature;
+};
+
+namespace Detail
+{
+    template <typename... Ts>
+    constexpr CallSite MakeCallSite(TypeList<Ts...>, const char* format, const char* file, int line)
+    {
+        return CallSite{format, file, line, &Render<Ts...>, TypeList<Ts...>::kTypes.data(), sizeof...(Ts),
+                        &Signature<Ts...>::kValue};
+    }
+} // namespace Detail
+
+class CallSiteSwitch;
+
+// Forces the QLOG_TRACE ... QLOG_CRITICAL call sites in files whose path ends
+// with `file` (and on `line`, unless 0) to log whatever the Logger level is, or
+// with `enabled` false returns them to normal filtering. Later calls override
+// earlier ones, and sites not reached yet pick the setting up on first use.
+// Returns the number of already registered sites that matched.
+size_t EnableCallSites(const char* file, int line = 0, bool enabled = true);
+
+// Static enable flag behind each QLOG_ level macro use. Constant initialized,
+// so checking it is a relaxed load; the site joins the registry the first time
+// it runs.
+class CallSiteSwitch
+{
+public:
+    constexpr CallSiteSwitch(const char* file, int line) noexcept
+        : m_file(file),
+          m_line(line)
+    {}
+
+    CallSiteSwitch(const CallSiteSwitch&) = delete;
+    CallSiteSwitch& operator=(const CallSiteSwitch&) = delete;
+
+    bool Enabled()
+    {
+        std::uint8_t state = m_state.load(std::memory_order_relaxed);
+        if (state == kUnregistered)
+        {
+            state = Register();
+        }
+        return state == kForced;
+    }
+
+    const char* File() const { return m_file; }
+    int Line() const { return m_line; }
+
+private:
+    friend size_t EnableCallSites(const char* file, int line, bool enabled);
+
+    static constexpr std::uint8_t kUnregistered = 0;
+    static constexpr std::uint8_t kFiltered = 1;
+    static constexpr std::uint8_t kForced = 2;
+
+    std::uint8_t Register();
+
+    const char* m_file;
+    int m_line;
+    std::atomic<std::uint8_t> m_state{kUnregistered};
+    CallSiteSwitch* m_next{nullptr}; // registry list, guarded by its mutex
+};
+
+// Static per-call-site limiter behind QLOG_SAMPLED and QLOG_RATE_LIMITED.
+// Admit() runs after the level check and before the arguments are evaluated,
+// so a suppressed call costs no formatting, no allocation and no queue slot.
+class LogLimiter
+{
+public:
+    // Lets through the first of every `every` calls
+    static constexpr LogLimiter Sampled(std::uint32_t every) noexcept
+    {
+        return LogLimiter(every != 0 ? every : 1, 0, 0);
+    }
+    // Token bucket refilled at `perSecond` (> 0) that holds up to `burst` calls
+    static constexpr LogLimiter RateLimited(double perSecond, std::uint32_t burst) noexcept
+    {
+        const double interval = perSecond > 0 ? 1e9 / perSecond : kMaxIntervalNs;
+        const auto ns = interval < 1 ? 1 : interval > kMaxIntervalNs ? kMaxIntervalNs : static_cast<std::int64_t>(interval);
+        const std::int64_t tokens = burst < 1 ? 1 : burst > kMaxBurst ? kMaxBurst : burst;
+        return LogLimiter(1, ns, (tokens - 1) * ns);
+    }
+
+    LogLimiter(const LogLimiter&) = delete;
+    LogLimiter& operator=(const LogLimiter&) = delete;
+
+    // False counts the call as suppressed
+    bool Admit()
+    {
+        const bool admitted = m_intervalNs != 0 ? AdmitRate()
+                                                : m_calls.fetch_add(1, std::memory_order_relaxed) % m_every == 0;
+        if (!admitted)
+        {
+            m_suppressed.fetch_add(1, std::memory_order_relaxed);
+        }
+        return admitted;
+    }
+
+    // Calls suppressed since the last time this was asked, for the summary record
+    std::uint64_t TakeSuppressed()
+    {
+        return m_suppressed.load(std::memory_order_relaxed) != 0
+                   ? m_suppressed.exchange(0, std::memory_order_relaxed) : 0;
+    }
+
+private:
+    static constexpr std::int64_t kMaxIntervalNs = 3600'000'000'000; // one per hour
+    static constexpr std::int64_t kMaxBurst = 1 << 20;
+
+    constexpr LogLimiter(std::uint32_t every, std::int64_t intervalNs, std::int64_t toleranceNs) noexcept
+        : m_every(every),
+          m_intervalNs(intervalNs),
+          m_toleranceNs(toleranceNs)
+    {}
+
+    bool AdmitRate();
+
+    const std::uint32_t m_every;
+    // Rate limiting as a virtual-scheduling token bucket: m_dueNs is when the
+    // bucket will be full again, and a call fits while that is at most
+    // m_toleranceNs (burst - 1 intervals) ahead of now
+    const std::int64_t m_intervalNs;
+    const std::int64_t m_toleranceNs;
+    std::atomic<std::uint64_t> m_calls{0};
+    std::atomic<std::int64_t> m_dueNs{0};
+    std::atomic<std::uint64_t> m_suppressed{0};
+};
+
+// Console sink writes to std::ostream (defaults to std::clog)
+class OStreamSink : public Sink
+{
+public:
+    explicit OStreamSink(std::ostream& os);
+    void Write(const Message& message) override;
+    void WriteBatch(const Message* messages, size_t count) override;
+    void Flush() override;
+private:
+    std::ostream& m_os;
+    std::string m_buffer; // batch text, reused between batches
+};
+
+// Discards every record without rendering or touching it; for measuring the
+// Logger on its own and for tests that only care about the caller side
+class NullSink final : public Sink
+{
+public:
+    void Write(const Message&) override {}
+    void WriteBatch(const Message*, size_t) override {}
+    bool AcceptsDeferred() const override { return true; } // skip rendering too
+};
+
+// Move-only owner of an OS file handle (fd on POSIX, HANDLE on Windows) with
+// unbuffered writes. Failures throw std::system_error.
+class File
+{
+public:
+    File() = default;
+    // Opens for appending, creating the file if needed
+    explicit File(const std::string& path, bool truncate = false);
+    ~File();
+
+    File(File&& other) noexcept;
+    File& operator=(File&& other) noexcept;
+    File(const File&) = delete;
+    File& operator=(const File&) = delete;
+
+    bool IsOpen() const { return m_handle != kInvalid; }
+    std::intptr_t NativeHandle() const { return m_handle; }
+    // Writes all `size` bytes, retrying short writes
+    void Write(const char* data, size_t size);
+    void Close();
+
+private:
+    static constexpr std::intptr_t kInvalid = -1;
+    std::intptr_t m_handle{kInvalid};
+};
+
+inline constexpr size_t kDefaultFileBufferSize = 256 * 1024;
+
+// How FileSink hands a full buffer to the OS
+enum class FileIo : std::uint8_t
+{
+    Sync, // write(2)/WriteFile on the worker thread
+    Async, // queue it and keep formatting into a spare buffer (up to three in all):
+           // io_uring on Linux when the kernel allows it, otherwise a dedicated I/O thread
+    AsyncThread // like Async, but always on the dedicated I/O thread
+};
+
+// File sink that formats records into a preallocated write-combining buffer
+// and hands it to the OS in one write(2)/WriteFile when full or on Flush.
+// Flush() returns once everything is written, also with FileIo::Async.
+class FileSink : public Sink
+{
+public:
+    explicit FileSink(const std::string& path,
+                      size_t bufferSize = kDefaultFileBufferSize,
+                      bool truncate = false,
+                      FileIo io = FileIo::Sync);
+    ~FileSink() override;
+
+    void Write(const Message& message) override;
+    void WriteBatch(const Message* messages, size_t count) override;
+    void Flush() override;
+
+    // FileIo::Async backend; defined in FileSink.cpp
+    class AsyncWriter;
+
+protected:
+    // Writes out buffered records, then switches to `file`; returns the previous file
+    File ReplaceFile(File file);
+    // Bytes accepted since construction or the last ReplaceFile
+    std::uint64_t BytesWritten() const { return m_bytesWritten; }
+    void Append(const Message& message);
+
+private:
+    void WriteBuffer();
+
+    File m_file;
+    std::unique_ptr<AsyncWriter> m_async; // FileIo::Async: writes in flight and spare buffers
+    std::unique_ptr<char[]> m_buffer;
+    const size_t m_bufferSize;
+    size_t m_used{0};
+    std::uint64_t m_bytesWritten{0};
+};
+
+// How RotatingFileSink post-processes finished segments
+enum class Compression : std::uint8_t
+{
+    None,
+    Gzip // needs QLog built with zlib (QLOG_WITH_ZLIB); otherwise segments stay uncompressed
+};
+
+struct RotationOptions
+{
+    std::uint64_t maxBytes{0};          // start a new segment at this size (0 = no size limit)
+    std::chrono::seconds interval{0};   // start a new segment at each multiple of this since the epoch (0 = off)
+    size_t bufferSize{kDefaultFileBufferSize};
+    FileIo io{FileIo::Sync};
+    Compression compression{Compression::None};
+    // Optional custom post-processing (e.g. zstd) run instead of `compression`
+    // on the background thread with the finished segment's path
+    std::function<void(const std::string& path)> onSegmentClosed;
+};
+
+// FileSink that writes numbered segments "<basePath>.1", "<basePath>.2", ...
+// rotating by size and/or time. The next segment is opened ahead of time and
+// finished ones are closed and compressed on a low-priority thread, so a
+// rotation on the worker is just a buffer write and a handle swap.
+class RotatingFileSink : public FileSink
+{
+public:
+    explicit RotatingFileSink(const std::string& basePath, RotationOptions options = {});
+    ~RotatingFileSink() override;
+
+    void Write(const Message& message) override;
+    void WriteBatch(const Message* messages, size_t count) override;
+
+    // Path of the segment currently being written
+    std::string CurrentPath() const;
+
+private:
+    RotatingFileSink(const std::string& basePath, RotationOptions options, std::uint64_t firstIndex);
+    bool RotationDue(std::chrono::system_clock::time_point now) const;
+    void Rotate(std::chrono::system_clock::time_point now);
+    void Housekeeper();
+    std::string SegmentPath(std::uint64_t index) const;
+
+    const std::string m_basePath;
+    const RotationOptions m_options;
+    std::uint64_t m_index;
+    std::chrono::system_clock::time_point m_nextBoundary{};
+
+    mutable std::mutex m_mtx;
+    std::condition_variable m_cv;
+    std::optional<File> m_nextFile;                          // pre-opened segment m_index + 1
+    std::deque<std::pair<File, std::string>> m_finished;     // segments to close and compress, oldest first
+    bool m_prepareNext{true};
+    bool m_stop{false};
+    std::thread m_housekeeper;
+};
+
+inline constexpr size_t kDefaultRingFileCapacity = 64u << 20;
+
+// Sink that memcpy's text records into a memory-mapped file used as a circular
+// buffer, with a small header holding the write cursor. No write calls are made,
+// and the newest `capacity` bytes survive a crash in the page cache. An existing
+// ring file of the same capacity is continued. Read back with ReadRingFile or
+// the qlog_ringdump tool.
+class MappedRingFileSink : public Sink
+{
+public:
+    explicit MappedRingFileSink(const std::string& path, size_t capacity = kDefaultRingFileCapacity);
+    ~MappedRingFileSink() override;
+
+    MappedRingFileSink(const MappedRingFileSink&) = delete;
+    MappedRingFileSink& operator=(const MappedRingFileSink&) = delete;
+
+    void Write(const Message& message) override;
+    void WriteBatch(const Message* messages, size_t count) override;
+
+private:
+    void Append(const Message& message);
+    void CopyIn(const char* data, size_t size);
+
+    char* m_view{nullptr};   // header followed by the ring
+    size_t m_viewSize{0};
+    char* m_data{nullptr};
+    size_t m_capacity{0};
+    std::uint64_t m_cursor{0};   // total bytes ever written
+    std::intptr_t m_file{-1};
+    std::intptr_t m_mapping{-1}; // Windows file mapping handle
+    std::string m_scratch;
+};
+
+// Extracts the complete records of a ring file, oldest first.
+// Returns false if `path` is not a QLog ring file.
+bool ReadRingFile(const std::string& path, std::string& out);
+
+// Keeps the newest `records` formatted records in memory, in fixed slots of
+// `slotSize` bytes allocated up front; a longer record is cut to fit its slot
+// (keeping the newline). Nothing is allocated after construction, so it is a
+// cheap flight recorder and a bounded capture sink for tests.
+class MemoryRingSink : public Sink
+{
+public:
+    explicit MemoryRingSink(size_t records, size_t slotSize = 256);
+
+    MemoryRingSink(const MemoryRingSink&) = delete;
+    MemoryRingSink& operator=(const MemoryRingSink&) = delete;
+
+    void Write(const Message& message) override;
+    void WriteBatch(const Message* messages, size_t count) override;
+
+    // Retained records, oldest first
+    std::string Text() const;
+    std::vector<std::string> Lines() const;
+    size_t Size() const;
+    std::uint64_t Written() const; // records ever written, overwritten ones included
+    void Clear();
+
+    // Writes the retained records to a file descriptor without locking or
+    // allocating, for crash handlers; a record written concurrently may come
+    // out torn. Returns the bytes written.
+    size_t DumpTo(int fd) const;
+
+private:
+    void Append(const Message& message);
+
+    const size_t m_slots;
+    const size_t m_slotSize;
+    std::unique_ptr<char[]> m_data;
+    std::unique_ptr<std::uint32_t[]> m_lengths;
+    std::atomic<std::uint64_t> m_written{0};
+    mutable std::mutex m_mtx;
+};
+
+struct NetworkSinkOptions
+{
+    // Bytes of formatted records held while the collector is slow or away; the
+    // oldest are dropped beyond it, so the worker never waits on the network
+    size_t spillCapacity{4 << 20};
+    // Delay before reconnecting, doubled after each failure up to the maximum
+    std::chrono::milliseconds reconnectMin{100};
+    std::chrono::milliseconds reconnectMax{5000};
+    // How long Flush() may wait for the spill to drain (0 = just try once)
+    std::chrono::milliseconds flushTimeout{0};
+};
+
+struct NetworkSinkStats
+{
+    std::uint64_t bytesSent{0};
+    std::uint64_t recordsDropped{0}; // lost to the spill limit
+    std::uint64_t connects{0};
+    size_t spilledBytes{0};          // formatted but not yet sent
+    bool connected{false};
+};
+
+// Streams text records to a collector over a Unix domain or TCP stream socket
+// ("unix:/run/collector.sock", "tcp:host:port"). The socket is non-blocking:
+// each batch is appended to a bounded spill buffer and sent with one gathering
+// sendmsg as far as the socket accepts it, and connecting/reconnecting only
+// happens in steps that never wait, so a dead collector costs the worker
+// nothing. Spilled records go out on the next write or Flush(); with an idle
+// Logger, LoggerOptions::flushInterval keeps retrying. POSIX only: the
+// constructor throws std::system_error on Windows.
+class NetworkSink : public Sink
+{
+public:
+    // Throws std::invalid_argument for a malformed address and std::system_error
+    // if a TCP host cannot be resolved
+    explicit NetworkSink(const std::string& address, const NetworkSinkOptions& options = NetworkSinkOptions{});
+    ~NetworkSink() override;
+
+    NetworkSink(const NetworkSink&) = delete;
+    NetworkSink& operator=(const NetworkSink&) = delete;
+
+    void Write(const Message& message) override;
+    void WriteBatch(const Message* messages, size_t count) override;
+    void Flush() override;
+
+    NetworkSinkStats GetStats() const;
+
+private:
+    enum class State : std::uint8_t
+    {
+        Disconnected,
+        Connecting,
+        Connected
+    };
+    struct Block
+    {
+        std::string data;
+        size_t records{0};
+    };
+
+    void Append(const Message& message);
+    void TrimSpill();
+    void Service();
+    void StartConnect(std::chrono::steady_clock::time_point now);
+    void FinishConnect(std::chrono::steady_clock::time_point now);
+    void Send();
+    void Disconnect(std::chrono::steady_clock::time_point now);
+    void WaitWritable(std::chrono::steady_clock::time_point deadline);
+
+    const NetworkSinkOptions m_options;
+    const size_t m_blockSize;
+    std::vector<char> m_address; // sockaddr bytes
+    int m_family{0};
+    std::intptr_t m_socket{-1};
+    State m_state{State::Disconnected};
+    std::chrono::steady_clock::time_point m_nextAttempt{};
+    std::chrono::steady_clock::time_point m_connectStarted{};
+    std::chrono::milliseconds m_backoff;
+    std::deque<Block> m_blocks;
+    size_t m_sentOffset{0}; // bytes of m_blocks.front() already on the wire
+    size_t m_spilled{0};
+    std::string m_scratch;
+
+    std::atomic<std::uint64_t> m_bytesSent{0};
+    std::atomic<std::uint64_t> m_recordsDropped{0};
+    std::atomic<std::uint64_t> m_connects{0};
+    std::atomic<size_t> m_spilledBytes{0};
+    std::atomic<bool> m_connected{false};
+};
+
+// Sink that stores records in a compact binary form instead of text. Deferred
+// records are written unformatted: each distinct format string/argument layout
+// is defined once per stream, and records refer to it by number and carry only
+// their typed arguments, so the producing process never runs printf. Read back
+// with BinaryLogReader or the qlog_decode tool. Layout (integers are LEB128
+// varints, "s" = varint length and bytes):
+//   stream:     "QLOGBIN1" entry*
+//   definition: 0x01 id s:format count (kind size)*
+//   record:     0x02 level flags [zigzag ns delta to the previous timestamp] id args
+// Record id 0 is already rendered text (args = s:text). Arguments by kind: 'i'
+// zigzag varint, 'u'/'p' varint, 'f' IEEE float/double by size, 'F' double, 's' s.
+class BinarySink : public Sink
+{
+public:
+    explicit BinarySink(std::ostream& os);
+
+    void Write(const Message& message) override;
+    void WriteBatch(const Message* messages, size_t count) override;
+    void Flush() override;
+    bool AcceptsDeferred() const override { return true; }
+
+private:
+    void Append(const Message& message);
+    std::uint64_t DefinitionId(const Message& message);
+    void WriteBuffer();
+
+    std::ostream& m_os;
+    std::string m_buffer;
+    std::string m_render;
+    struct KnownFormat
+    {
+        std::uint64_t id;
+        std::string format;
+    };
+    // Looked up by format address, then checked against the text: a
+    // LogDeferred format need not be a literal, and a freed one's address can
+    // come back holding a different string
+    std::map<std::pair<const char*, const Detail::ArgSignature*>, KnownFormat> m_definitions;
+    std::map<std::pair<std::string, const Detail::ArgSignature*>, std::uint64_t> m_definitionIds; // by content
+    std::int64_t m_lastTimestamp{0};
+};
+
+// One decoded argument; `kind`/`size` as in BinarySink's definitions
+struct BinaryArg
+{
+    char kind{};
+    std::uint8_t size{};
+    std::uint64_t bits{}; // integers and pointers ('i' sign-extended)
+    double real{};        // 'f', 'F'
+    std::string text;     // 's'
+};
+
+struct BinaryRecord
+{
+    Level level{};
+    std::optional<std::chrono::system_clock::time_point> timestamp;
+    std::string format; // empty for records that were stored as text
+    std::vector<BinaryArg> args;
+    std::string text;   // format rendered with args, or the stored text
+};
+
+// Decodes a BinarySink stream record by record
+class BinaryLogReader
+{
+public:
+    explicit BinaryLogReader(std::istream& in);
+
+    // False if the stream does not start with the BinarySink magic
+    bool Valid() const { return m_valid; }
+    // Reads the next record; false at the end of the stream or on a malformed
+    // entry, which Corrupt() then reports
+    bool Next(BinaryRecord& record);
+    bool Corrupt() const { return m_corrupt; }
+
+private:
+    struct Definition
+    {
+        std::string format;
+        std::vector<Detail::ArgType> types;
+    };
+
+    bool ReadDefinition();
+    bool ReadRecord(BinaryRecord& record);
+
+    std::istream& m_in;
+    std::vector<Definition> m_definitions; // id - 1
+    std::int64_t m_lastTimestamp{0};
+    bool m_valid{false};
+    bool m_corrupt{false};
 };
 
-// Console sink writes to std::ostream (defaults to std::clog)
-class OStreamSink : public Sink
+// Renders a decoded record as one line of JSON (no trailing newline):
+// {"ts_ns":...,"level":"INFO","format":"...","args":[...],"text":"..."}
+std::string FormatJson(const BinaryRecord& record);
+
+inline constexpr size_t kDefaultArenaSize = 512 * 1024;
+
+// What a producer does when the queue is at capacity
+enum class Backpressure : std::uint8_t
+{
+    DropOldest,   // evict the oldest queued record (QueueMode::PerThread drops the newest instead)
+    DropNewest,   // discard the record being logged; costs nothing beyond the failed push
+    Block,        // wait until the worker makes room; never loses records
+    SpinThenBlock // retry briefly without sleeping, then wait like Block
+};
+
+// How the worker waits for records. Producers only signal a parked worker, so
+// with the spinning strategies a busy logger never makes a wakeup syscall.
+enum class WaitStrategy : std::uint8_t
+{
+    Park,         // sleep on a condition variable as soon as the queue is empty
+    SpinThenPark, // poll briefly first, catching bursts without a wakeup
+    BusySpin      // never sleep; burns a core (meant for a pinned/isolated one)
+};
+
+// Records lost to, or delayed by, the backpressure policy since construction
+struct BackpressureStats
+{
+    std::uint64_t droppedNewest{0};
+    std::uint64_t droppedOldest{0};
+    std::uint64_t blocked{0}; // times a producer had to wait for room
+};
+
+// Log2-bucketed distribution of nanosecond durations: bucket i counts samples
+// in [2^(i-1), 2^i), the last one everything longer
+struct LatencyHistogram
+{
+    static constexpr size_t kBuckets = 40;
+
+    std::array<std::uint64_t, kBuckets> buckets{};
+    std::uint64_t samples{0};
+
+    // Upper bound in nanoseconds of the bucket holding quantile q (0..1); 0 when empty
+    std::uint64_t Percentile(double q) const;
+};
+
+// Logger::GetStats() snapshot; counters run from construction
+struct LoggerStats
+{
+    std::uint64_t enqueued{0};         // records that made it into the queue
+    std::uint64_t dropped{0};          // lost to the backpressure policy
+    std::uint64_t written{0};          // handed to the sinks
+    std::uint64_t peakQueueDepth{0};   // most records seen waiting at once
+    std::uint64_t arenaAllocations{0}; // record storage carved from the arena
+    std::uint64_t heapAllocations{0};  // records that did not fit and used the heap
+    BackpressureStats backpressure;
+    // Enqueue-to-write delay of every kLatencySampleStride-th timestamped record
+    LatencyHistogram latency;
+};
+
+// One record in this many has its queueing delay sampled into LoggerStats::latency
+inline constexpr size_t kLatencySampleStride = 16;
+
+class LogBackend;
+
+// Construction-time Logger configuration
+struct LoggerOptions
 {
-public:
-    explicit OStreamSink(std::ostream& os);
-    void Write(const Message& message) override;
-    void Flush() override;
-private:
-    std::ostream& m_os;
+    Level level{Level::Info};
+    // Maximum queued messages; `backpressure` decides what happens when full.
+    // 0 = unbounded for QueueMode::Locked, or kDefaultRingCapacity slots for the
+    // ring modes. With QueueMode::PerThread the bound applies to each producer thread.
+    size_t capacity{0};
+    QueueMode queueMode{QueueMode::Locked};
+    ClockSource clock{ClockSource::System};
+    // Bytes of record storage shared by all producers; records that do not fit
+    // (or all of them, with 0) are heap allocated
+    size_t arenaSize{kDefaultArenaSize};
+    // Blocking policies must not be used by code that runs on the worker thread
+    // (e.g. a sink logging through the same Logger)
+    Backpressure backpressure{Backpressure::DropOldest};
+    // Automatic Sink::Flush once written records have waited this long, or once
+    // this many have been written since the last flush. 0 = only on Flush()/Shutdown().
+    std::chrono::milliseconds flushInterval{0};
+    size_t flushThreshold{0};
+    WaitStrategy waitStrategy{WaitStrategy::Park};
+    // Serve this Logger from a shared LogBackend instead of its own worker
+    // thread (waitStrategy is then unused). The backend must outlive the Logger.
+    LogBackend* backend{nullptr};
+    // Called on the worker with a GetStats() snapshot this often, and once more
+    // at shutdown. 0 or an empty callback = never.
+    std::chrono::milliseconds statsInterval{0};
+    std::function<void(const LoggerStats&)> onStats{};
+    // Lets the crash handler (InstallCrashHandler) write this Logger's queued
+    // records when the process dies
+    bool crashDrain{false};
+    // Defer the arena, the ring and the worker thread (or backend registration)
+    // until the first record passes the level filter, so a Logger that is never
+    // used costs no storage and no thread
+    bool lazyStart{false};
 };
 
+// Ring size used by the ring queue modes when no capacity is given
+inline constexpr size_t kDefaultRingCapacity = 4096;
+
 // Thread-safe async logger with background thread and non-blocking enqueue
 class Logger
 {
 public:
-    // Ctor starts background thread. If capacity==0, queue is unbounded, else drops oldest when full.
+    // Ctor starts background thread (unless LoggerOptions::lazyStart). If capacity==0, queue is unbounded, else drops oldest when full.
     explicit Logger(Sink& sink,
                     Level initialLevel = Level::Info,
                     size_t capacity = 0);
+    Logger(Sink& sink, const LoggerOptions& options);
     ~Logger();
 
     Logger(const Logger&) = delete;
     Logger& operator=(const Logger&) = delete;
 
     // Non-blocking log enqueue; may drop message if below level or queue policy decides
-    void Log(Level level, const char* format, va_list args);
-    void Log(Level level, const char* format, ...);
+    void Log(Level level, const char* format, va_list args) QLOG_PRINTF_LIKE(3, 0);
+    void Log(Level level, const char* format, ...) QLOG_PRINTF_LIKE(3, 4);
+    // Skips the level check, for callers that already made it (the QLOG_ level macros)
+    void LogUnfiltered(Level level, const char* format, ...) QLOG_PRINTF_LIKE(3, 4);
+
+    // One relaxed load; lets callers skip building arguments for filtered records
+    bool IsEnabled(Level level) const
+    {
+        return level >= m_level.load(std::memory_order_relaxed);
+    }
 
     // Convenience helpers
-    void Trace(const char* format, ...)
+    void Trace(const char* format, ...) QLOG_PRINTF_LIKE(2, 3)
     {
+        if (!IsEnabled(Level::Trace))
+        {
+            return;
+        }
         va_list args;
         va_start(args, format);
-        Log(Level::Trace, format, args);
+        LogFormatted(Level::Trace, format, args);
         va_end(args);
     }
-    void Debug(const char* format, ...)
+    void Debug(const char* format, ...) QLOG_PRINTF_LIKE(2, 3)
     {
+        if (!IsEnabled(Level::Debug))
+        {
+            return;
+        }
         va_list args;
         va_start(args, format);
-        Log(Level::Debug, format, args);
+        LogFormatted(Level::Debug, format, args);
         va_end(args);
     }
-    void Info(const char* format, ...)
+    void Info(const char* format, ...) QLOG_PRINTF_LIKE(2, 3)
     {
+        if (!IsEnabled(Level::Info))
+        {
+            return;
+        }
         va_list args;
         va_start(args, format);
-        Log(Level::Info, format, args);
+        LogFormatted(Level::Info, format, args);
         va_end(args);
     }
-    void Warn(const char* format, ...)
+    void Warn(const char* format, ...) QLOG_PRINTF_LIKE(2, 3)
     {
+        if (!IsEnabled(Level::Warn))
+        {
+            return;
+        }
         va_list args;
         va_start(args, format);
-        Log(Level::Warn, format, args);
+        LogFormatted(Level::Warn, format, args);
         va_end(args);
     }
-    void Error(const char* format, ...)
+    void Error(const char* format, ...) QLOG_PRINTF_LIKE(2, 3)
     {
+        if (!IsEnabled(Level::Error))
+        {
+            return;
+        }
         va_list args;
         va_start(args, format);
-        Log(Level::Error, format, args);
+        LogFormatted(Level::Error, format, args);
         va_end(args);
     }
-    void Critical(const char* format, ...)
+    void Critical(const char* format, ...) QLOG_PRINTF_LIKE(2, 3)
     {
+        if (!IsEnabled(Level::Critical))
+        {
+            return;
+        }
         va_list args;
         va_start(args, format);
-        Log(Level::Critical, format, args);
+        LogFormatted(Level::Critical, format, args);
         va_end(args);
     }
 
-    // Flushes sink after processing current queue
+    // Deferred printf-style logging: the caller only copies the arguments into
+    // pooled storage; formatting happens on the worker (or in the sink).
+    // Arguments must be arithmetic, pointers, or strings (copied by value).
+    // Only the format pointer is stored: it must stay valid until the record
+    // is written (a literal always does).
+    template <typename... Args>
+    void LogDeferred(Level level, const char* format, const Args&... args)
+    {
+        LogEncoded(level, format, &Detail::Signature<std::decay_t<Args>...>::kValue, args...);
+    }
+
+    // Deferred logging through a compile-time checked call site (see QLOG_DEFERRED).
+    // `format` is the same literal as site.format and is only there so the macro
+    // can forward its arguments unchanged.
+    template <typename... Args>
+    void LogSite(const CallSite& site, Level level, const char* /*format*/, const Args&... args)
+    {
+        LogEncoded(level, site.format, site.signature, args...);
+    }
+
+    // Sends every record at or above `minLevel` to another sink as well; the
+    // constructor's sink receives everything that passes the Logger level. Records
+    // are formatted once and shared. With `ownThread` the sink is drained by its
+    // own thread from a private backlog, so a slow sink (console, network) cannot
+    // hold back the others. The sink must outlive the Logger.
+    void AddSink(Sink& sink, Level minLevel = Level::Trace, bool ownThread = false);
+
+    // Blocks until every record logged before the call has been written and the
+    // sinks flushed. Called from the worker thread (inside a sink), only requests it.
     void Flush();
 
     // Stop background thread after draining queue
@@ -196,104 +1243,752 @@ public:
         return m_capacity;
     }
 
+    QueueMode GetQueueMode() const
+    {
+        return m_queueMode;
+    }
+
+    ClockSource GetClockSource() const
+    {
+        return m_clock.Source();
+    }
+
+    Backpressure GetBackpressure() const
+    {
+        return m_backpressure;
+    }
+    BackpressureStats GetBackpressureStats() const
+    {
+        return BackpressureStats{m_droppedNewest.load(std::memory_order_relaxed),
+                                 m_droppedOldest.load(std::memory_order_relaxed),
+                                 m_blocked.load(std::memory_order_relaxed)};
+    }
+    // Counters and the sampled latency histogram; callable from any thread
+    LoggerStats GetStats() const;
+
+    // Writes the records still queued to `fd` as text, in place and without
+    // dequeuing or locking, with write(2) as the only system call
+    // (InstallCrashHandler does this for Loggers with options.crashDrain).
+    // Returns the records written; needs options.crashDrain (0 otherwise).
+    // The worker and the producers keep running, but from here on the Logger
+    // never frees record storage again, so every record the drain reaches
+    // stays readable: call it only on the way out. It is a best-effort last resort:
+    // - deferred records come out as their format string, unrendered
+    // - PerThread rings come out one after another, and only those of the
+    //   first kMaxCrashRings live producer threads
+    // - a Locked queue is skipped if a push or pop was under way when the
+    //   drain started, and one that starts during the walk can still tear it
+    size_t EmergencyDrain(int fd);
+    static constexpr size_t kMaxCrashRings = 256;
+
 private:
+    template <typename... Args>
+    void LogEncoded(Level level, const char* format, const Detail::ArgSignature* signature, const Args&... args)
+    {
+        if (level < m_level.load(std::memory_order_relaxed))
+        {
+            return;
+        }
+        const size_t size = (size_t{0} + ... + Detail::ArgCodec<std::decay_t<Args>>::Size(args));
+        ThrowIfBreak(level);
+        size_t room;
+        Record* rec = AllocateRecord(level, true, size, room);
+        StampRecord(*rec);
+        rec->Deferred().format = format;
+        rec->Deferred().signature = signature;
+        char* out = rec->Payload();
+        ((out = Detail::ArgCodec<std::decay_t<Args>>::Encode(out, args)), ...);
+        (void)out;
+        rec->length = static_cast<std::uint32_t>(size);
+        Enqueue(rec);
+        TrapIfBreak(level);
+    }
+
+    // Packed header at the start of each record's pooled storage, followed by
+    // the text (or a DeferredInfo and the encoded arguments). Queues carry only
+    // a pointer to it; the worker expands it into a Message for the sink.
+    struct DeferredInfo
+    {
+        const char* format;
+        const Detail::ArgSignature* signature;
+    };
+    struct alignas(8) Record
+    {
+        static constexpr std::uint8_t kTimestamp = 1; // tick holds a TickClock reading
+        static constexpr std::uint8_t kDeferred = 2;  // payload is encoded arguments
+        static constexpr std::uint8_t kPooled = 4;    // storage came from m_arena
+
+        std::uint64_t tick;
+        std::uint32_t length; // payload bytes
+        Level level;
+        std::uint8_t flags;
+
+        static size_t HeaderSize(bool deferred)
+        {
+            return sizeof(Record) + (deferred ? sizeof(DeferredInfo) : 0);
+        }
+        DeferredInfo& Deferred()
+        {
+            return *reinterpret_cast<DeferredInfo*>(this + 1);
+        }
+        char* Payload()
+        {
+            return reinterpret_cast<char*>(this) + HeaderSize((flags & kDeferred) != 0);
+        }
+    };
+    static_assert(sizeof(Record) == 16, "record header should stay two words");
+
+    friend class LogBackend;
+
+    void LogFormatted(Level level, const char* format, va_list args) QLOG_PRINTF_LIKE(3, 0);
+    void Start();
     void Worker();
+    bool Pump(size_t maxBatches);
+    void FinishWorker();
+    void WaitForWork();
+    bool HasWork();
+    void WakeWorker();
+    void NotifyWorker();
+    // Before the record is built: BreakMode::Throw
+    void ThrowIfBreak(Level level);
+    // After it is queued: BreakMode::DebugBreak, so the trap sees it logged
+    void TrapIfBreak(Level level);
+    Record* AllocateRecord(Level level, bool deferred, size_t payloadSize, size_t& room);
+    void StampRecord(Record& rec);
+    // False once EmergencyDrain froze a crashDrain Logger's storage
+    bool ReleaseAllowed() const;
+    void ReleaseRecord(Record* rec);
+    void FreeStorage(Record* rec);
+    void Enqueue(Record* rec);
+    bool TryPublish(Record* rec);
+    bool SpinPublish(Record* rec);
+    bool BlockingPublish(Record* rec);
+    void NotifySpace();
+    void CaptureFlushTargets();
+    bool FlushTargetsReached();
+    bool AutoFlushDue(std::chrono::steady_clock::time_point now) const;
+    bool StatsDue(std::chrono::steady_clock::time_point now) const;
+    void ReportStats(std::chrono::steady_clock::time_point now);
+    // When the worker must wake up even without records (auto flush, stats)
+    std::chrono::steady_clock::time_point NextDeadline() const;
+    void FlushSinks(std::chrono::steady_clock::time_point now, bool wait);
+    void CompleteFlushes(std::uint64_t upTo);
+    bool TryDequeue(Record*& rec);
+    size_t DequeueBatch(std::vector<Record*>& batch, size_t maxCount);
+    void NoteQueueDepth(size_t depth);
+    struct StatShard;
+    StatShard& LocalStatShard();
+    void SampleLatency();
+    void ExpandBatch();
+    void WriteSinks();
+    void RefreshSinks();
+
+    // Raw tick source for ClockSource::Steady/Tsc. Producers only call Now();
+    // the worker owns the tick -> system_clock calibration and refreshes it
+    // periodically so drift and wall-clock adjustments are tracked.
+    class TickClock
+    {
+    public:
+        explicit TickClock(ClockSource source);
+
+        ClockSource Source() const { return m_source; }
+        // ClockSource::System readings are system_clock nanoseconds
+        std::uint64_t Now() const;
+        std::chrono::system_clock::time_point ToSystem(std::uint64_t tick) const;
+        std::uint64_t ElapsedNs(std::uint64_t from, std::uint64_t to) const;
+        void MaybeRecalibrate();
+
+    private:
+        void Recalibrate();
+
+        ClockSource m_source;
+        bool m_counter{false};     // ticks are a hardware counter needing a measured rate
+        double m_nsPerTick{1.0};
+        std::uint64_t m_baseTick{0};
+        std::int64_t m_baseNs{0};  // system_clock nanoseconds at m_baseTick
+        // Start of the rate measurement, against steady_clock so that steps of
+        // the wall clock (NTP, settimeofday) only move m_baseNs
+        std::uint64_t m_firstTick{0};
+        std::uint64_t m_firstSteadyNs{0};
+        std::chrono::steady_clock::time_point m_nextCalibration{};
+    };
+    bool QueueEmpty();
+    bool ProducersEmpty();
+    void RefreshProducers();
+    void PublishCrashRings();
 
-    // Simple fixed-block buffer pool to minimize heap allocations for message text
-    class BufferPool
+    // Bounded lock-free ring of record pointers (Vyukov-style sequence per slot).
+    // Pop is safe from several threads so producers can evict the oldest entry
+    // when the ring is full; in normal operation only the worker pops.
+    class MessageRing
     {
     public:
-        BufferPool(size_t blockSize, size_t blockCount)
-            : m_blockSize(blockSize),
-              m_storage(blockSize * blockCount),
-              m_freeList(blockCount),
-              m_freeCount(blockCount)
+        explicit MessageRing(size_t capacity)
+            : m_slots(new Slot[capacity]),
+              m_capacity(capacity)
         {
-            for (size_t i = 0; i < blockCount; ++i)
+            for (size_t i = 0; i < capacity; ++i)
             {
-                m_freeList[i] = static_cast<std::uint32_t>(i);
+                m_slots[i].seq.store(i, std::memory_order_relaxed);
             }
         }
 
-        struct Allocation
+        // Returns false without blocking when the ring is full
+        bool TryPush(Record* rec)
         {
-            void* ptr{nullptr};
-            size_t size{0};
-            bool pooled{false};
+            size_t pos = m_tail.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                Slot& slot = m_slots[pos % m_capacity];
+                const size_t seq = slot.seq.load(std::memory_order_acquire);
+                const auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+                if (diff == 0)
+                {
+                    if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    {
+                        slot.rec = rec;
+                        slot.seq.store(pos + 1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (diff < 0)
+                {
+                    return false; // full
+                }
+                else
+                {
+                    pos = m_tail.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        // Returns false when there is nothing published to pop
+        bool TryPop(Record*& out)
+        {
+            size_t pos = m_head.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                Slot& slot = m_slots[pos % m_capacity];
+                const size_t seq = slot.seq.load(std::memory_order_acquire);
+                const auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+                if (diff == 0)
+                {
+                    if (m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    {
+                        out = slot.rec;
+                        slot.seq.store(pos + m_capacity, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (diff < 0)
+                {
+                    return false; // empty
+                }
+                else
+                {
+                    pos = m_head.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        bool Empty() const
+        {
+            return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+        }
+
+        // Visits the published records without popping them (EmergencyDrain)
+        template <typename Fn>
+        void ForEachPending(Fn&& fn) const
+        {
+            const size_t tail = m_tail.load(std::memory_order_acquire);
+            for (size_t pos = m_head.load(std::memory_order_acquire); pos != tail; ++pos)
+            {
+                const Slot& slot = m_slots[pos % m_capacity];
+                if (slot.seq.load(std::memory_order_acquire) == pos + 1)
+                {
+                    fn(slot.rec);
+                }
+            }
+        }
+
+        // Monotonic positions, used as flush targets
+        size_t PushedCount() const { return m_tail.load(std::memory_order_acquire); }
+        size_t PoppedCount() const { return m_head.load(std::memory_order_acquire); }
+
+    private:
+        // 16-byte slots: four per cache line keeps the ring dense for the worker
+        struct Slot
+        {
+            std::atomic<size_t> seq{0};
+            Record* rec{nullptr};
         };
 
-        Allocation Allocate(size_t n)
+        std::unique_ptr<Slot[]> m_slots;
+        const size_t m_capacity;
+        alignas(64) std::atomic<size_t> m_head{0}; // next position to pop
+        alignas(64) std::atomic<size_t> m_tail{0}; // next position to push
+    };
+
+    // Single-producer/single-consumer ring owned by one producer thread
+    // (QueueMode::PerThread). Each side caches the other's index so the shared
+    // cache lines are only touched when the cached view runs out.
+    class ProducerRing
+    {
+    public:
+        explicit ProducerRing(size_t capacity)
+            : m_slots(new Record*[capacity]),
+              m_capacity(capacity)
+        {}
+
+        // Producer side; returns false when full
+        bool TryPush(Record* rec)
         {
-            if (n <= m_blockSize && m_freeCount > 0)
+            const size_t tail = m_tail.load(std::memory_order_relaxed);
+            if (tail - m_cachedHead >= m_capacity)
             {
-                auto idx = m_freeList[--m_freeCount];
-                return Allocation{ m_storage.data() + static_cast<ptrdiff_t>(idx) * static_cast<ptrdiff_t>(m_blockSize), m_blockSize, true };
+                m_cachedHead = m_head.load(std::memory_order_acquire);
+                if (tail - m_cachedHead >= m_capacity)
+                {
+                    return false;
+                }
             }
-            // Fallback to heap for large messages
-            char* p = new char[n];
-            return Allocation{ p, n, false };
+            m_slots[tail % m_capacity] = rec;
+            m_tail.store(tail + 1, std::memory_order_release);
+            return true;
         }
 
-        void Deallocate(void* p, size_t /*n*/, bool pooled)
+        // Consumer side; returns the oldest record or nullptr when empty
+        Record* Peek()
         {
-            if (!p) return;
-            if (pooled)
+            const size_t head = m_head.load(std::memory_order_relaxed);
+            if (head == m_cachedTail)
             {
-                char* base = m_storage.data();
-                ptrdiff_t diff = static_cast<char*>(p) - base;
-                if (diff >= 0 && static_cast<size_t>(diff) < m_storage.size())
+                m_cachedTail = m_tail.load(std::memory_order_acquire);
+                if (head == m_cachedTail)
                 {
-                    auto idx = static_cast<std::uint32_t>(diff / static_cast<ptrdiff_t>(m_blockSize));
-                    m_freeList[m_freeCount++] = idx;
+                    return nullptr;
                 }
             }
-            else
+            return m_slots[head % m_capacity];
+        }
+
+        // Consumer side; discards the record returned by Peek
+        void Pop()
+        {
+            m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        bool Empty() const
+        {
+            return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+        }
+
+        size_t PushedCount() const { return m_tail.load(std::memory_order_acquire); }
+        size_t PoppedCount() const { return m_head.load(std::memory_order_acquire); }
+
+        // Visits the queued records without popping them (EmergencyDrain)
+        template <typename Fn>
+        void ForEachPending(Fn&& fn) const
+        {
+            const size_t tail = m_tail.load(std::memory_order_acquire);
+            for (size_t pos = m_head.load(std::memory_order_acquire); pos != tail; ++pos)
             {
-                delete[] static_cast<char*>(p);
+                fn(m_slots[pos % m_capacity]);
             }
         }
 
+        std::atomic<bool> producerExited{false}; // owning thread has ended
+        std::atomic<bool> loggerStopped{false};  // Logger no longer drains this ring
+
     private:
-        size_t m_blockSize{0};
-        std::vector<char> m_storage;           // contiguous backing storage
-        std::vector<std::uint32_t> m_freeList;  // stack of free block indices
-        size_t m_freeCount{0};
+        std::unique_ptr<Record*[]> m_slots;
+        const size_t m_capacity;
+        alignas(64) std::atomic<size_t> m_head{0};
+        size_t m_cachedTail{0}; // consumer's view of m_tail
+        alignas(64) std::atomic<size_t> m_tail{0};
+        size_t m_cachedHead{0}; // producer's view of m_head
     };
 
-    // Helper to release any storage held by a message
-    void ReleaseMessageStorage(Message& msg)
+    ProducerRing& LocalProducerRing();
+
+    // Contiguous byte ring that records are carved from. Producers reserve
+    // exactly the bytes they need with one CAS on the head; released chunks are
+    // marked free and the tail sweeps over them in allocation order, so an
+    // out-of-order release only delays reuse. Requests that do not fit fall
+    // back to the heap.
+    class ByteArena
     {
-        if (msg.storage)
+    public:
+        // Without `commit`, the storage is only allocated by Commit()
+        explicit ByteArena(size_t capacity, bool commit = true);
+        void Commit();
+
+        struct Allocation
+        {
+            void* ptr{nullptr};
+            size_t size{0};
+            bool pooled{false}; // from the arena rather than the heap
+        };
+
+        Allocation Allocate(size_t n);
+        // Gives back the end of a pooled allocation, keeping its first n bytes.
+        // Bytes past n must not have been written.
+        void Shrink(void* p, size_t n);
+        void Deallocate(void* p, bool pooled);
+
+    private:
+        // Precedes every chunk; a zero state means a reservation still being set up
+        struct Chunk
+        {
+            std::atomic<std::uint32_t> state;
+            std::uint32_t size; // including this header, a multiple of kAlign
+        };
+        static constexpr std::uint32_t kInUse = 1;
+        static constexpr std::uint32_t kFree = 2;
+        static constexpr size_t kAlign = 8;
+
+        Chunk* ChunkAt(std::uint64_t pos) const
         {
-            std::lock_guard<std::mutex> lk(m_poolMtx);
-            m_pool.Deallocate(msg.storage, msg.storageSize, msg.storagePooled);
-            msg.storage = nullptr;
-            msg.storageSize = 0;
-            msg.storagePooled = false;
-            msg.text = std::string_view{};
+            return reinterpret_cast<Chunk*>(m_data.get() + pos % m_capacity);
         }
-    }
+        bool TryReserve(size_t total, Chunk*& chunk);
+        void Reclaim();
+
+        const size_t m_capacity;
+        std::unique_ptr<char[]> m_data; // free space is kept zeroed
+        alignas(64) std::atomic<std::uint64_t> m_head{0};     // next byte to reserve
+        alignas(64) std::atomic<std::uint64_t> m_tail{0};     // oldest byte still in use
+        std::atomic<std::uint64_t> m_releases{0};             // lets Reclaim notice frees it raced with
+        std::atomic<bool> m_reclaiming{false};
+    };
+
+    // One destination and its level filter. Sinks with their own thread get
+    // copies of the batch's Messages and of their text or arguments: the arena
+    // frees in allocation order, so a stalled sink holding records would push
+    // every producer onto the heap fallback.
+    class SinkChannel
+    {
+    public:
+        SinkChannel(Logger& owner, Sink& sink, Level minLevel, bool ownThread);
+        ~SinkChannel();
+
+        SinkChannel(const SinkChannel&) = delete;
+        SinkChannel& operator=(const SinkChannel&) = delete;
+
+        Sink& GetSink() const { return m_sink; }
+        bool Detached() const { return m_detached; }
+        bool Accepts(Level level) const { return level >= m_minLevel; }
+
+        // Worker side. Post copies what it needs; the records stay the worker's.
+        void Post(const std::vector<Message>& batch, const std::vector<Record*>& records);
+        std::uint64_t RequestFlush();
+        void WaitFlushed(std::uint64_t ticket);
+        void Stop(); // drains the backlog, flushes and joins
+
+        // Hands an inline batch to the sink, dropping records below the filter
+        void Write(const std::vector<Message>& batch, std::vector<Message>& scratch);
+
+    private:
+        void Drain();
+        void CompactBytes();
 
-    std::shared_ptr<Sink> m_sink;
+        Logger& m_owner;
+        Sink& m_sink;
+        const Level m_minLevel;
+        const bool m_detached;
+        std::mutex m_mtx;
+        std::condition_variable m_cv;
+        // Queued Messages, whose text or arguments sit at `offset` in m_bytes
+        struct Pending
+        {
+            Message message;
+            size_t offset;
+        };
+        std::deque<Pending> m_pending;
+        std::vector<char> m_bytes;
+        std::uint64_t m_flushRequested{0};
+        std::uint64_t m_flushDone{0};
+        bool m_stop{false};
+        std::thread m_thread;
+    };
+
+    // The constructor's sink, which Start() turns into the first channel
+    Sink& m_primarySink;
+    const bool m_crashDrain;
+    // Sink registry; the worker keeps its own snapshot like m_workerProducers
+    std::mutex m_sinksMtx;
+    std::vector<std::shared_ptr<SinkChannel>> m_sinks;
+    std::atomic<std::uint64_t> m_sinksVersion{0};
+    std::vector<std::shared_ptr<SinkChannel>> m_workerSinks;
+    std::uint64_t m_workerSinksVersion{0};
+    bool m_hasDetachedSinks{false};
 
     mutable std::mutex m_mtx;
     std::condition_variable m_cv;
-    std::deque<Message> m_queue;
+    std::optional<std::deque<Record*>> m_queue; // QueueMode::Locked, from Start()
+    // QueueMode::Locked positions: written under m_mtx, read without it
+    std::atomic<size_t> m_queuePushed{0};
+    std::atomic<size_t> m_queuePopped{0};
+    std::atomic<size_t> m_queueEpoch{0}; // odd while m_queue changes (QueueChange)
     const size_t m_capacity;
+    const QueueMode m_queueMode;
+    const Backpressure m_backpressure;
+    const WaitStrategy m_waitStrategy;
+    TickClock m_clock;
+    std::unique_ptr<MessageRing> m_ring; // set when m_queueMode == QueueMode::LockFree
+
+    // QueueMode::PerThread registry; the worker keeps its own snapshot and
+    // re-reads the registry only when m_producersVersion changes
+    const std::uint64_t m_id;
+    std::mutex m_producersMtx;
+    std::vector<std::shared_ptr<ProducerRing>> m_producers;
+    std::atomic<std::uint64_t> m_producersVersion{0};
+    std::vector<std::shared_ptr<ProducerRing>> m_workerProducers;
+    std::uint64_t m_workerProducersVersion{0};
+    // Copy of m_producers' ring pointers that EmergencyDrain can read without
+    // the lock; kept only with crashDrain, rewritten under m_producersMtx
+    std::unique_ptr<std::atomic<ProducerRing*>[]> m_crashRings;
+    std::atomic<size_t> m_crashRingCount{0};
+    std::atomic<bool> m_crashFrozen{false}; // set by EmergencyDrain
 
     std::atomic<Level> m_level;
     std::atomic<Level> m_breakLevel{Level::Critical};
     std::atomic<bool> m_breakEnabled{false};
     std::atomic<BreakMode> m_breakMode{BreakMode::DebugBreak};
     std::atomic<bool> m_running{true};
-    std::atomic<bool> m_flushRequested{false};
+    // Set by the worker (under m_mtx) right before it parks; the first producer
+    // to see it clears it and pays for the wakeup
+    alignas(64) std::atomic<bool> m_workerSleeping{false};
+
+    // Producers parked by Backpressure::Block wait here for the worker to drain
+    std::mutex m_spaceMtx;
+    std::condition_variable m_spaceCv;
+    std::atomic<std::uint32_t> m_waitingProducers{0};
+    alignas(64) std::atomic<std::uint64_t> m_droppedNewest{0};
+    std::atomic<std::uint64_t> m_droppedOldest{0};
+    std::atomic<std::uint64_t> m_blocked{0};
+    // Producer-side counters, sharded by thread so producers rarely share a line
+    static constexpr size_t kStatShards = 16;
+    struct alignas(64) StatShard
+    {
+        std::atomic<std::uint64_t> allocated{0};
+        std::atomic<std::uint64_t> enqueued{0};
+    };
+    std::unique_ptr<StatShard[]> m_statShards; // kStatShards of them, from Start()
+    std::atomic<std::uint64_t> m_heapAllocations{0};
+    // Worker-side counters; only the worker stores, GetStats reads
+    std::atomic<std::uint64_t> m_written{0};
+    std::atomic<std::uint64_t> m_peakDepth{0};
+    std::array<std::atomic<std::uint64_t>, LatencyHistogram::kBuckets> m_latency{};
+    std::atomic<std::uint64_t> m_latencySamples{0};
+    size_t m_sampleCountdown{0};
+    // Flush() tickets: requests are bumped by callers, completions published by the worker
+    std::mutex m_flushMtx;
+    std::condition_variable m_flushCv;
+    std::atomic<std::uint64_t> m_flushRequests{0};
+    std::uint64_t m_flushCompleted{0}; // guarded by m_flushMtx
+    bool m_workerDone{false};          // guarded by m_flushMtx
     std::atomic<bool> m_timestampsEnabled{true};
 
+    // Storage and worker are created once, by Start(); m_startMtx orders that
+    // against Shutdown()
+    std::mutex m_startMtx;
+    std::atomic<bool> m_started{false};
+    bool m_workerLaunched{false}; // thread or backend registration; guarded by m_startMtx
     std::thread m_worker;
-    BufferPool m_pool{512, 1024}; // default pool: 1024 blocks of 512 bytes
-    std::mutex m_poolMtx;
+    // With a shared backend: held by whichever backend thread is serving this
+    // Logger, and for good once Shutdown() has taken the Logger back
+    LogBackend* const m_backend;
+    std::atomic<bool> m_claimed{false};
+    // Worker-only state: the current batch of records, the Messages built from
+    // them, a rendered copy for sinks that want text, and per-sink filtering space
+    std::vector<Record*> m_records;
+    std::vector<Message> m_batch;
+    bool m_batchDeferred{false};
+    std::vector<Message> m_textBatch;
+    std::string m_renderBuffer;
+    std::vector<size_t> m_renderOffsets;
+    std::vector<Message> m_filtered;
+    std::vector<std::uint64_t> m_flushTickets;
+    // Worker-only flush state: the latest request seen and the queue positions
+    // that must be drained before it is answered
+    std::uint64_t m_flushObserved{0};
+    bool m_flushPending{false};
+    size_t m_flushTarget{0};
+    std::vector<std::pair<std::shared_ptr<ProducerRing>, size_t>> m_flushTargets;
+    const std::chrono::milliseconds m_flushInterval;
+    const size_t m_flushThreshold;
+    size_t m_unflushed{0};
+    std::chrono::steady_clock::time_point m_lastFlush{};
+    const std::chrono::milliseconds m_statsInterval;
+    const std::function<void(const LoggerStats&)> m_onStats;
+    std::chrono::steady_clock::time_point m_nextStats{};
+    ByteArena m_arena;
+};
+
+// Opt-in emergency drain for crashes. Fatal signals (SIGSEGV, SIGBUS, SIGILL,
+// SIGFPE, SIGABRT) and std::terminate write the records still queued in every
+// Logger created with LoggerOptions::crashDrain to `fd` (opened beforehand,
+// e.g. stderr or a crash file) with Logger::EmergencyDrain, then hand over to
+// the previous handler. Calling it again only changes the descriptor.
+void InstallCrashHandler(int fd);
+void UninstallCrashHandler();
+
+// Worker threads shared by any number of Loggers (LoggerOptions::backend), so
+// the thread count stays fixed however many Loggers are created. Each Logger
+// keeps its own queue, level and sinks; the threads serve them round-robin, one
+// thread per Logger at a time, and park while every queue is empty. A Logger's
+// Shutdown() drains its remaining records on the calling thread.
+class LogBackend
+{
+public:
+    explicit LogBackend(size_t threads = 1);
+    ~LogBackend();
+
+    LogBackend(const LogBackend&) = delete;
+    LogBackend& operator=(const LogBackend&) = delete;
+
+    size_t ThreadCount() const { return m_threads.size(); }
+    size_t LoggerCount() const;
+
+private:
+    friend class Logger;
+
+    void Add(Logger& logger);
+    void Remove(Logger& logger);
+    void Wake();
+    void Run();
+    Logger* Claim();
+
+    mutable std::mutex m_mtx;
+    std::condition_variable m_cv;
+    std::vector<Logger*> m_loggers; // guarded by m_mtx, as is claiming one
+    size_t m_next{0};
+    bool m_stop{false};
+    // Threads parked on m_cv; producers only signal when it is non-zero
+    alignas(64) std::atomic<int> m_idle{0};
+    std::vector<std::thread> m_threads;
+};
+
+// N independent Loggers ("shards"), each with its own queue, worker thread and
+// sink, for workloads where one worker cannot keep up with formatting and I/O.
+// Every producer thread sticks to one shard, so a thread's records stay in
+// order; records of different shards are only ordered by timestamp, e.g. with
+// MergeLogFiles over per-shard files.
+class ShardedLogger
+{
+public:
+    // One shard per sink; `options` applies to every shard
+    ShardedLogger(const std::vector<Sink*>& sinks, const LoggerOptions& options = LoggerOptions{});
+
+    ShardedLogger(const ShardedLogger&) = delete;
+    ShardedLogger& operator=(const ShardedLogger&) = delete;
+
+    // The calling thread's shard
+    Logger& Local();
+    Logger& Shard(size_t index) { return *m_shards[index]; }
+    size_t ShardCount() const { return m_shards.size(); }
+
+    // Checked before the shard is looked up, so filtered calls cost what they
+    // do on a Logger. Follows SetLevel, not a single shard's own level.
+    bool IsEnabled(Level level) const
+    {
+        return level >= m_level.load(std::memory_order_relaxed);
+    }
+
+    void Log(Level level, const char* format, ...) QLOG_PRINTF_LIKE(3, 4);
+    void Trace(const char* format, ...) QLOG_PRINTF_LIKE(2, 3)
+    {
+        if (!IsEnabled(Level::Trace))
+        {
+            return;
+        }
+        va_list args;
+        va_start(args, format);
+        Local().Log(Level::Trace, format, args);
+        va_end(args);
+    }
+    void Debug(const char* format, ...) QLOG_PRINTF_LIKE(2, 3)
+    {
+        if (!IsEnabled(Level::Debug))
+        {
+            return;
+        }
+        va_list args;
+        va_start(args, format);
+        Local().Log(Level::Debug, format, args);
+        va_end(args);
+    }
+    void Info(const char* format, ...) QLOG_PRINTF_LIKE(2, 3)
+    {
+        if (!IsEnabled(Level::Info))
+        {
+            return;
+        }
+        va_list args;
+        va_start(args, format);
+        Local().Log(Level::Info, format, args);
+        va_end(args);
+    }
+    void Warn(const char* format, ...) QLOG_PRINTF_LIKE(2, 3)
+    {
+        if (!IsEnabled(Level::Warn))
+        {
+            return;
+        }
+        va_list args;
+        va_start(args, format);
+        Local().Log(Level::Warn, format, args);
+        va_end(args);
+    }
+    void Error(const char* format, ...) QLOG_PRINTF_LIKE(2, 3)
+    {
+        if (!IsEnabled(Level::Error))
+        {
+            return;
+        }
+        va_list args;
+        va_start(args, format);
+        Local().Log(Level::Error, format, args);
+        va_end(args);
+    }
+    void Critical(const char* format, ...) QLOG_PRINTF_LIKE(2, 3)
+    {
+        if (!IsEnabled(Level::Critical))
+        {
+            return;
+        }
+        va_list args;
+        va_start(args, format);
+        Local().Log(Level::Critical, format, args);
+        va_end(args);
+    }
+    template <typename... Args>
+    void LogDeferred(Level level, const char* format, const Args&... args)
+    {
+        if (!IsEnabled(level))
+        {
+            return;
+        }
+        Local().LogDeferred(level, format, args...);
+    }
+
+    // Apply to every shard
+    void Flush();
+    void Shutdown();
+    void SetLevel(Level level);
+
+private:
+    std::vector<std::unique_ptr<Logger>> m_shards;
+    std::atomic<Level> m_level;
 };
 
+// Merges text logs written by the shards of a ShardedLogger into `out`,
+// ordered by their "[timestamp]" prefix; ties keep file order and lines without
+// a timestamp stay with the record before them. Returns false if a file cannot
+// be opened.
+bool MergeLogFiles(const std::vector<std::string>& paths, std::ostream& out);
+
 // Helper to stringify levels
 const char* ToString(Level level) noexcept;
 
@@ -301,4 +1996,156 @@ const char* ToString(Level level) noexcept;
 // Returns formatted string like "[2025-09-27 14:30:15.123456] " or empty string if no timestamp
 std::string FormatTimestamp(const Message& message);
 
+// Same as above, written into `out` (kTimestampBufferSize bytes are always enough).
+// Returns the length written, 0 if the message has no timestamp. Uses a
+// per-thread TimestampFormatter, so repeated calls within a second are cheap.
+inline constexpr size_t kTimestampBufferSize = 32;
+size_t FormatTimestamp(const Message& message, char* out, size_t size);
+
+// Caching formatter for "[YYYY-mm-dd HH:MM:SS.uuuuuu] " in local time. The
+// date/time prefix is rebuilt only when the second changes (otherwise only the
+// microsecond digits are written) and the UTC offset is resolved once per
+// quarter hour, so there is no localtime call or tz lock per record. Not thread-safe.
+class TimestampFormatter
+{
+public:
+    static constexpr size_t kLength = 29; // excluding the terminating NUL
+
+    // Writes kLength characters plus a NUL to `out`; returns kLength
+    size_t Format(std::chrono::system_clock::time_point tp, char* out);
+
+private:
+    static constexpr size_t kPrefixLength = 21; // "[YYYY-mm-dd HH:MM:SS."
+
+    void Rebuild(std::int64_t second);
+
+    std::int64_t m_second{INT64_MIN};
+    std::int64_t m_offsetBlock{INT64_MIN};
+    std::int64_t m_utcOffset{0};
+    char m_prefix[kPrefixLength]{};
+};
+
+// Upper bound on the bytes FormatRecord writes for `message`
+inline size_t MaxRecordSize(const Message& message)
+{
+    return kTimestampBufferSize + 16 + message.text.size();
+}
+
+// Formats the default text record "[ts] LEVEL: text\n" into `out`, which must
+// hold at least MaxRecordSize(message) bytes. Returns the bytes written.
+size_t FormatRecord(const Message& message, char* out);
+
 } // namespace QLog
+
+#define QLOG_DETAIL_EXPAND(x) x
+#define QLOG_DETAIL_FIRST_(first, ...) first
+#define QLOG_DETAIL_FIRST(...) QLOG_DETAIL_EXPAND(QLOG_DETAIL_FIRST_(__VA_ARGS__, unused))
+
+// Deferred logging with a format literal checked against the arguments at compile
+// time and one static CallSite per use:
+//   QLOG_DEFERRED(logger, QLog::Level::Info, "took %d ms", ms);
+#define QLOG_DEFERRED(logger, level, ...)                                                             \
+    do                                                                                                \
+    {                                                                                                 \
+        using QlogArgTypes = decltype(::QLog::Detail::ArgumentTypes(__VA_ARGS__));                  \
+        constexpr auto qlogFormatCheck = QlogArgTypes::Check(QLOG_DETAIL_FIRST(__VA_ARGS__));        \
+        static_assert(qlogFormatCheck != ::QLog::Detail::FormatError::TooFewArguments,                \
+                      "QLog: format string expects more arguments");                                  \
+        static_assert(qlogFormatCheck != ::QLog::Detail::FormatError::TooManyArguments,               \
+                      "QLog: more arguments than format conversions");                                \
+        static_assert(qlogFormatCheck != ::QLog::Detail::FormatError::TypeMismatch,                   \
+                      "QLog: argument type does not match its format conversion");                    \
+        static_assert(qlogFormatCheck != ::QLog::Detail::FormatError::UnsupportedConversion,          \
+                      "QLog: unsupported or malformed format conversion");                            \
+        static constexpr ::QLog::CallSite qlogSite =                                                  \
+            ::QLog::Detail::MakeCallSite(QlogArgTypes{}, QLOG_DETAIL_FIRST(__VA_ARGS__), __FILE__, __LINE__); \
+        (logger).LogSite(qlogSite, (level), __VA_ARGS__);                                            \
+    } while (0)
+
+// Compile-time floor for the QLOG_TRACE ... QLOG_CRITICAL macros, as a Level
+// value (0 = Trace ... 5 = Critical): uses below it compile to nothing,
+// arguments included
+#ifndef QLOG_MIN_LEVEL
+#  define QLOG_MIN_LEVEL 0
+#endif
+
+// printf-style logging that evaluates its arguments only when the record will
+// be kept: the Logger level allows it, or EnableCallSites forced this site on.
+//   QLOG_DEBUG(logger, "queue depth %zu", Depth());
+#define QLOG_DETAIL_LOG(logger, level, ...)                                                           \
+    do                                                                                                \
+    {                                                                                                 \
+        static ::QLog::CallSiteSwitch qlogSwitch{__FILE__, __LINE__};                                 \
+        auto& qlogLogger = (logger);                                                                  \
+        if (qlogLogger.IsEnabled(level) || qlogSwitch.Enabled())                                      \
+        {                                                                                             \
+            qlogLogger.LogUnfiltered((level), __VA_ARGS__);                                           \
+        }                                                                                             \
+    } while (0)
+#define QLOG_DETAIL_DISABLED(logger, ...) do { } while (0)
+
+// Level-checked logging through a static LogLimiter; the first record the site
+// lets through after suppressing some is preceded by a "suppressed N messages"
+// record at the same level. Levels below QLOG_MIN_LEVEL are skipped as well, so
+// with a constant level the whole site, limiter included, compiles away.
+//   QLOG_SAMPLED(logger, QLog::Level::Debug, 100, "packet %u", id);        // 1 in 100
+//   QLOG_RATE_LIMITED(logger, QLog::Level::Warn, 10, 20, "retry %d", n);  // 10/s, bursts of 20
+#if QLOG_MIN_LEVEL > 0
+#  define QLOG_DETAIL_KEPT_LEVEL(level) (static_cast<int>(level) >= QLOG_MIN_LEVEL)
+#else
+#  define QLOG_DETAIL_KEPT_LEVEL(level) true
+#endif
+#define QLOG_DETAIL_LIMITED(logger, level, limiter, ...)                                              \
+    do                                                                                                \
+    {                                                                                                 \
+        if (QLOG_DETAIL_KEPT_LEVEL(level))                                                            \
+        {                                                                                             \
+            static ::QLog::LogLimiter qlogLimiter = limiter;                                          \
+            auto& qlogLogger = (logger);                                                              \
+            if (qlogLogger.IsEnabled((level)) && qlogLimiter.Admit())                                 \
+            {                                                                                         \
+                if (const auto qlogSuppressed = qlogLimiter.TakeSuppressed())                         \
+                {                                                                                     \
+                    qlogLogger.LogUnfiltered((level), "suppressed %llu messages at %s:%d",            \
+                                             static_cast<unsigned long long>(qlogSuppressed), __FILE__, \
+                                             __LINE__);                                               \
+                }                                                                                     \
+                qlogLogger.LogUnfiltered((level), __VA_ARGS__);                                       \
+            }                                                                                         \
+        }                                                                                             \
+    } while (0)
+#define QLOG_SAMPLED(logger, level, every, ...)                                                      \
+    QLOG_DETAIL_LIMITED(logger, level, ::QLog::LogLimiter::Sampled(every), __VA_ARGS__)
+#define QLOG_RATE_LIMITED(logger, level, perSecond, burst, ...)                                      \
+    QLOG_DETAIL_LIMITED(logger, level, ::QLog::LogLimiter::RateLimited((perSecond), (burst)), __VA_ARGS__)
+
+#if QLOG_MIN_LEVEL <= 0
+#  define QLOG_TRACE(logger, ...) QLOG_DETAIL_LOG(logger, ::QLog::Level::Trace, __VA_ARGS__)
+#else
+#  define QLOG_TRACE(logger, ...) QLOG_DETAIL_DISABLED(logger, __VA_ARGS__)
+#endif
+#if QLOG_MIN_LEVEL <= 1
+#  define QLOG_DEBUG(logger, ...) QLOG_DETAIL_LOG(logger, ::QLog::Level::Debug, __VA_ARGS__)
+#else
+#  define QLOG_DEBUG(logger, ...) QLOG_DETAIL_DISABLED(logger, __VA_ARGS__)
+#endif
+#if QLOG_MIN_LEVEL <= 2
+#  define QLOG_INFO(logger, ...) QLOG_DETAIL_LOG(logger, ::QLog::Level::Info, __VA_ARGS__)
+#else
+#  define QLOG_INFO(logger, ...) QLOG_DETAIL_DISABLED(logger, __VA_ARGS__)
+#endif
+#if QLOG_MIN_LEVEL <= 3
+#  define QLOG_WARN(logger, ...) QLOG_DETAIL_LOG(logger, ::QLog::Level::Warn, __VA_ARGS__)
+#else
+#  define QLOG_WARN(logger, ...) QLOG_DETAIL_DISABLED(logger, __VA_ARGS__)
+#endif
+#if QLOG_MIN_LEVEL <= 4
+#  define QLOG_ERROR(logger, ...) QLOG_DETAIL_LOG(logger, ::QLog::Level::Error, __VA_ARGS__)
+#else
+#  define QLOG_ERROR(logger, ...) QLOG_DETAIL_DISABLED(logger, __VA_ARGS__)
+#endif
+#if QLOG_MIN_LEVEL <= 5
+#  define QLOG_CRITICAL(logger, ...) QLOG_DETAIL_LOG(logger, ::QLog::Level::Critical, __VA_ARGS__)
+#else
+#  define QLOG_CRITICAL(logger, ...) QLOG_DETAIL_DISABLED(logger, __VA_ARGS__)
+#endif
@@ -0,0 +1,662 @@
+#include "QLog.h"
+
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <istream>
+#include <ostream>
+
+namespace QLog
+{
+
+namespace
+{
+    constexpr char kBinaryMagic[8] = {'Q', 'L', 'O', 'G', 'B', 'I', 'N', '1'};
+    constexpr char kDefinitionTag = 0x01;
+    constexpr char kRecordTag = 0x02;
+    constexpr std::uint8_t kHasTimestamp = 1;
+
+    // Batches are written in one call; a long one is cut at about this size
+    constexpr size_t kBinaryWriteThreshold = 64 * 1024;
+
+    void PutVarint(std::string& out, std::uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    std::uint64_t ZigZag(std::int64_t value)
+    {
+        return (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63);
+    }
+
+    std::int64_t UnZigZag(std::uint64_t value)
+    {
+        return static_cast<std::int64_t>(value >> 1) ^ -static_cast<std::int64_t>(value & 1);
+    }
+
+    void PutString(std::string& out, std::string_view text)
+    {
+        PutVarint(out, text.size());
+        out.append(text);
+    }
+
+    // Fixed-width little-endian, whatever the host order
+    void PutFixed(std::string& out, std::uint64_t bits, size_t size)
+    {
+        for (size_t i = 0; i < size; ++i)
+        {
+            out.push_back(static_cast<char>(bits >> (8 * i)));
+        }
+    }
+
+    template <typename T>
+    T Load(const char*& in)
+    {
+        T value;
+        std::memcpy(&value, in, sizeof(T));
+        in += sizeof(T);
+        return value;
+    }
+
+    std::int64_t LoadSigned(const char*& in, size_t size)
+    {
+        switch (size)
+        {
+            case 1: return Load<std::int8_t>(in);
+            case 2: return Load<std::int16_t>(in);
+            case 4: return Load<std::int32_t>(in);
+            default: return Load<std::int64_t>(in);
+        }
+    }
+
+    std::uint64_t LoadUnsigned(const char*& in, size_t size)
+    {
+        switch (size)
+        {
+            case 1: return Load<std::uint8_t>(in);
+            case 2: return Load<std::uint16_t>(in);
+            case 4: return Load<std::uint32_t>(in);
+            default: return Load<std::uint64_t>(in);
+        }
+    }
+
+    std::int64_t TimestampNs(std::chrono::system_clock::time_point tp)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(tp.time_since_epoch()).count();
+    }
+
+    bool GetVarint(std::istream& in, std::uint64_t& value)
+    {
+        value = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            const int c = in.get();
+            if (c == std::char_traits<char>::eof())
+            {
+                return false;
+            }
+            value |= static_cast<std::uint64_t>(c & 0x7F) << shift;
+            if ((c & 0x80) == 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool GetString(std::istream& in, std::string& text)
+    {
+        std::uint64_t size;
+        if (!GetVarint(in, size) || size > (std::uint64_t{1} << 31))
+        {
+            return false;
+        }
+        text.resize(static_cast<size_t>(size));
+        return static_cast<bool>(in.read(text.data(), static_cast<std::streamsize>(text.size())));
+    }
+
+    bool GetFixed(std::istream& in, size_t size, std::uint64_t& bits)
+    {
+        char bytes[8];
+        if (!in.read(bytes, static_cast<std::streamsize>(size)))
+        {
+            return false;
+        }
+        bits = 0;
+        for (size_t i = 0; i < size; ++i)
+        {
+            bits |= static_cast<std::uint64_t>(static_cast<unsigned char>(bytes[i])) << (8 * i);
+        }
+        return true;
+    }
+
+    void AppendFormatted(std::string& out, const char* spec, ...) QLOG_PRINTF_LIKE(2, 3);
+    void AppendFormatted(std::string& out, const char* spec, ...)
+    {
+        char local[256];
+        va_list args;
+        va_start(args, spec);
+        va_list retry;
+        va_copy(retry, args);
+        const int len = std::vsnprintf(local, sizeof(local), spec, args);
+        va_end(args);
+        if (len >= static_cast<int>(sizeof(local)))
+        {
+            const size_t offset = out.size();
+            out.resize(offset + static_cast<size_t>(len) + 1);
+            std::vsnprintf(out.data() + offset, static_cast<size_t>(len) + 1, spec, retry);
+            out.resize(offset + static_cast<size_t>(len));
+        }
+        else if (len > 0)
+        {
+            out.append(local, static_cast<size_t>(len));
+        }
+        va_end(retry);
+    }
+
+    // printf over decoded arguments: each conversion is re-issued on its own,
+    // with '*' fields spelled out and integers widened to long long after the
+    // truncation their length modifier implies
+    std::string RenderArgs(const std::string& format, const std::vector<BinaryArg>& args)
+    {
+        std::string out;
+        size_t next = 0;
+        auto integer = [&](size_t index) -> std::uint64_t { return index < args.size() ? args[index].bits : 0; };
+        for (size_t i = 0; i < format.size();)
+        {
+            if (format[i] != '%')
+            {
+                out.push_back(format[i++]);
+                continue;
+            }
+            if (i + 1 < format.size() && format[i + 1] == '%')
+            {
+                out.push_back('%');
+                i += 2;
+                continue;
+            }
+            const size_t start = i++;
+            std::string spec = "%";
+            while (i < format.size() && std::strchr("-+ #0", format[i]))
+            {
+                spec.push_back(format[i++]);
+            }
+            for (int part = 0; part < 2; ++part) // width, then precision
+            {
+                if (part == 1)
+                {
+                    if (i >= format.size() || format[i] != '.')
+                    {
+                        break;
+                    }
+                    ++i;
+                }
+                std::string field = part == 1 ? "." : "";
+                if (i < format.size() && format[i] == '*')
+                {
+                    const auto value = static_cast<int>(integer(next++));
+                    if (part == 1 && value < 0)
+                    {
+                        field.clear(); // a negative precision counts as none
+                    }
+                    else
+                    {
+                        field += std::to_string(value);
+                    }
+                    ++i;
+                }
+                while (i < format.size() && format[i] >= '0' && format[i] <= '9')
+                {
+                    field.push_back(format[i++]);
+                }
+                spec += field;
+            }
+            std::string modifier;
+            while (i < format.size() && std::strchr("hljztL", format[i]))
+            {
+                modifier.push_back(format[i++]);
+            }
+            int bits = 8 * static_cast<int>(sizeof(int));
+            if (modifier == "hh")
+            {
+                bits = 8;
+            }
+            else if (modifier == "h")
+            {
+                bits = 16;
+            }
+            else if (modifier == "l")
+            {
+                bits = 8 * static_cast<int>(sizeof(long));
+            }
+            else if (modifier == "ll" || modifier == "j" || modifier == "z" || modifier == "t")
+            {
+                bits = 64;
+            }
+            if (i >= format.size() || next >= args.size())
+            {
+                out.append(format, start, i - start); // malformed or missing argument: keep it as written
+                continue;
+            }
+            const char conv = format[i++];
+            const BinaryArg& arg = args[next++];
+            const std::uint64_t mask = bits == 64 ? ~std::uint64_t{0} : (std::uint64_t{1} << bits) - 1;
+            switch (conv)
+            {
+                case 'd': case 'i':
+                {
+                    std::uint64_t value = arg.bits & mask;
+                    if (bits < 64 && (value >> (bits - 1)) != 0)
+                    {
+                        value |= ~mask; // sign-extend
+                    }
+                    AppendFormatted(out, (spec + "lld").c_str(), static_cast<long long>(value));
+                    break;
+                }
+                case 'u': case 'o': case 'x': case 'X':
+                    AppendFormatted(out, (spec + "ll" + conv).c_str(), static_cast<unsigned long long>(arg.bits & mask));
+                    break;
+                case 'c':
+                    AppendFormatted(out, (spec + "c").c_str(), static_cast<int>(arg.bits));
+                    break;
+                case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+                    AppendFormatted(out, (spec + conv).c_str(), arg.real);
+                    break;
+                case 's':
+                    AppendFormatted(out, (spec + "s").c_str(), arg.text.c_str());
+                    break;
+                case 'p':
+                    AppendFormatted(out, (spec + "p").c_str(),
+                                    reinterpret_cast<const void*>(static_cast<std::uintptr_t>(arg.bits)));
+                    break;
+                default:
+                    out.append(format, start, i - start);
+                    break;
+            }
+        }
+        return out;
+    }
+
+    void AppendJsonString(std::string& out, std::string_view text)
+    {
+        out.push_back('"');
+        for (const char c : text)
+        {
+            switch (c)
+            {
+                case '"': out += "\\\""; break;
+                case '\\': out += "\\\\"; break;
+                case '\n': out += "\\n"; break;
+                case '\r': out += "\\r"; break;
+                case '\t': out += "\\t"; break;
+                default:
+                    if (static_cast<unsigned char>(c) < 0x20)
+                    {
+                        char escaped[8];
+                        std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(c));
+                        out += escaped;
+                    }
+                    else
+                    {
+                        out.push_back(c);
+                    }
+                    break;
+            }
+        }
+        out.push_back('"');
+    }
+}
+
+BinarySink::BinarySink(std::ostream& os)
+    : m_os(os)
+{
+    m_buffer.assign(kBinaryMagic, sizeof(kBinaryMagic));
+}
+
+void BinarySink::Write(const Message& message)
+{
+    Append(message);
+    WriteBuffer();
+}
+
+void BinarySink::WriteBatch(const Message* messages, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        Append(messages[i]);
+        if (m_buffer.size() >= kBinaryWriteThreshold)
+        {
+            WriteBuffer();
+        }
+    }
+    WriteBuffer();
+}
+
+void BinarySink::Flush()
+{
+    WriteBuffer();
+    m_os.flush();
+}
+
+void BinarySink::WriteBuffer()
+{
+    if (!m_buffer.empty())
+    {
+        m_os.write(m_buffer.data(), static_cast<std::streamsize>(m_buffer.size()));
+        m_buffer.clear();
+    }
+}
+
+std::uint64_t BinarySink::DefinitionId(const Message& message)
+{
+    const auto key = std::make_pair(message.format, message.signature);
+    const auto it = m_definitions.find(key);
+    if (it != m_definitions.end() && it->second.format == message.format)
+    {
+        return it->second.id;
+    }
+    auto content = m_definitionIds.emplace(std::make_pair(std::string(message.format), message.signature),
+                                           m_definitionIds.size() + 1);
+    const std::uint64_t id = content.first->second;
+    m_definitions.insert_or_assign(key, KnownFormat{id, message.format});
+    if (!content.second)
+    {
+        return id; // same text, new address
+    }
+
+    m_buffer.push_back(kDefinitionTag);
+    PutVarint(m_buffer, id);
+    PutString(m_buffer, message.format);
+    PutVarint(m_buffer, message.signature->count);
+    for (size_t i = 0; i < message.signature->count; ++i)
+    {
+        const Detail::ArgType type = message.signature->types[i];
+        m_buffer.push_back(type.kind);
+        // Long doubles travel as doubles
+        m_buffer.push_back(static_cast<char>(type.kind == 'F' ? sizeof(double) : type.size));
+    }
+    return id;
+}
+
+void BinarySink::Append(const Message& message)
+{
+    const bool raw = message.IsDeferred() && message.signature != nullptr;
+    const std::uint64_t id = raw ? DefinitionId(message) : 0;
+
+    m_buffer.push_back(kRecordTag);
+    m_buffer.push_back(static_cast<char>(message.level));
+    m_buffer.push_back(static_cast<char>(message.timestamp ? kHasTimestamp : 0));
+    if (message.timestamp)
+    {
+        const std::int64_t ns = TimestampNs(*message.timestamp);
+        PutVarint(m_buffer, ZigZag(ns - m_lastTimestamp));
+        m_lastTimestamp = ns;
+    }
+    PutVarint(m_buffer, id);
+    if (!raw)
+    {
+        PutString(m_buffer, RenderText(message, m_render));
+        return;
+    }
+
+    const char* in = static_cast<const char*>(message.args);
+    for (size_t i = 0; i < message.signature->count; ++i)
+    {
+        const Detail::ArgType type = message.signature->types[i];
+        switch (type.kind)
+        {
+            case 'i':
+                PutVarint(m_buffer, ZigZag(LoadSigned(in, type.size)));
+                break;
+            case 'u':
+            case 'p':
+                PutVarint(m_buffer, LoadUnsigned(in, type.size));
+                break;
+            case 'f':
+                if (type.size == sizeof(float))
+                {
+                    PutFixed(m_buffer, Load<std::uint32_t>(in), sizeof(float));
+                }
+                else
+                {
+                    PutFixed(m_buffer, Load<std::uint64_t>(in), sizeof(double));
+                }
+                break;
+            case 'F':
+            {
+                const double value = static_cast<double>(Load<long double>(in));
+                std::uint64_t bits;
+                std::memcpy(&bits, &value, sizeof(bits));
+                PutFixed(m_buffer, bits, sizeof(double));
+                break;
+            }
+            default:
+                PutString(m_buffer, Detail::StringCodec::Decode(in));
+                break;
+        }
+    }
+}
+
+BinaryLogReader::BinaryLogReader(std::istream& in)
+    : m_in(in)
+{
+    char magic[sizeof(kBinaryMagic)];
+    m_valid = m_in.read(magic, sizeof(magic)) && std::memcmp(magic, kBinaryMagic, sizeof(magic)) == 0;
+}
+
+bool BinaryLogReader::Next(BinaryRecord& record)
+{
+    if (!m_valid || m_corrupt)
+    {
+        return false;
+    }
+    for (;;)
+    {
+        const int tag = m_in.get();
+        if (tag == std::char_traits<char>::eof())
+        {
+            return false;
+        }
+        bool ok = false;
+        if (tag == kDefinitionTag)
+        {
+            ok = ReadDefinition();
+        }
+        else if (tag == kRecordTag)
+        {
+            if (ReadRecord(record))
+            {
+                return true;
+            }
+        }
+        else if (tag == kBinaryMagic[0])
+        {
+            // Another stream appended to this one: its ids and deltas start over
+            char magic[sizeof(kBinaryMagic) - 1];
+            ok = m_in.read(magic, sizeof(magic)) && std::memcmp(magic, kBinaryMagic + 1, sizeof(magic)) == 0;
+            m_definitions.clear();
+            m_lastTimestamp = 0;
+        }
+        if (!ok)
+        {
+            m_corrupt = true;
+            return false;
+        }
+    }
+}
+
+bool BinaryLogReader::ReadDefinition()
+{
+    std::uint64_t id;
+    std::uint64_t count;
+    Definition definition;
+    if (!GetVarint(m_in, id) || id != m_definitions.size() + 1 || !GetString(m_in, definition.format) ||
+        !GetVarint(m_in, count) || count > 4096)
+    {
+        return false;
+    }
+    for (std::uint64_t i = 0; i < count; ++i)
+    {
+        char type[2];
+        if (!m_in.read(type, sizeof(type)))
+        {
+            return false;
+        }
+        definition.types.push_back(Detail::ArgType{type[0], static_cast<std::uint8_t>(type[1])});
+    }
+    m_definitions.push_back(std::move(definition));
+    return true;
+}
+
+bool BinaryLogReader::ReadRecord(BinaryRecord& record)
+{
+    const int level = m_in.get();
+    const int flags = m_in.get();
+    if (flags == std::char_traits<char>::eof() || level > static_cast<int>(Level::Off))
+    {
+        return false;
+    }
+    record.level = static_cast<Level>(level);
+    record.timestamp.reset();
+    if (flags & kHasTimestamp)
+    {
+        std::uint64_t delta;
+        if (!GetVarint(m_in, delta))
+        {
+            return false;
+        }
+        m_lastTimestamp += UnZigZag(delta);
+        record.timestamp = std::chrono::system_clock::time_point(
+            std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds(m_lastTimestamp)));
+    }
+    std::uint64_t id;
+    if (!GetVarint(m_in, id) || id > m_definitions.size())
+    {
+        return false;
+    }
+    record.args.clear();
+    if (id == 0)
+    {
+        record.format.clear();
+        return GetString(m_in, record.text);
+    }
+
+    const Definition& definition = m_definitions[static_cast<size_t>(id - 1)];
+    record.format = definition.format;
+    for (const Detail::ArgType& type : definition.types)
+    {
+        BinaryArg& arg = record.args.emplace_back();
+        arg.kind = type.kind;
+        arg.size = type.size;
+        std::uint64_t bits;
+        switch (type.kind)
+        {
+            case 'i':
+                if (!GetVarint(m_in, bits))
+                {
+                    return false;
+                }
+                arg.bits = static_cast<std::uint64_t>(UnZigZag(bits));
+                break;
+            case 'u':
+            case 'p':
+                if (!GetVarint(m_in, arg.bits))
+                {
+                    return false;
+                }
+                break;
+            case 'f':
+            case 'F':
+                if (type.size == sizeof(float))
+                {
+                    std::uint32_t narrow;
+                    float value;
+                    if (!GetFixed(m_in, sizeof(float), bits))
+                    {
+                        return false;
+                    }
+                    narrow = static_cast<std::uint32_t>(bits);
+                    std::memcpy(&value, &narrow, sizeof(value));
+                    arg.real = value;
+                }
+                else
+                {
+                    if (type.size != sizeof(double) || !GetFixed(m_in, sizeof(double), bits))
+                    {
+                        return false;
+                    }
+                    std::memcpy(&arg.real, &bits, sizeof(arg.real));
+                }
+                break;
+            case 's':
+                if (!GetString(m_in, arg.text))
+                {
+                    return false;
+                }
+                break;
+            default:
+                return false;
+        }
+    }
+    record.text = RenderArgs(record.format, record.args);
+    return true;
+}
+
+std::string FormatJson(const BinaryRecord& record)
+{
+    std::string out = "{";
+    if (record.timestamp)
+    {
+        out += "\"ts_ns\":";
+        out += std::to_string(TimestampNs(*record.timestamp));
+        out += ',';
+    }
+    out += "\"level\":";
+    AppendJsonString(out, ToString(record.level));
+    if (!record.format.empty())
+    {
+        out += ",\"format\":";
+        AppendJsonString(out, record.format);
+        out += ",\"args\":[";
+        for (size_t i = 0; i < record.args.size(); ++i)
+        {
+            const BinaryArg& arg = record.args[i];
+            if (i != 0)
+            {
+                out += ',';
+            }
+            switch (arg.kind)
+            {
+                case 'i': out += std::to_string(static_cast<std::int64_t>(arg.bits)); break;
+                case 'u': out += std::to_string(arg.bits); break;
+                case 'f':
+                case 'F':
+                    if (std::isfinite(arg.real))
+                    {
+                        AppendFormatted(out, "%.17g", arg.real);
+                    }
+                    else
+                    {
+                        out += "null"; // JSON has no NaN or infinity
+                    }
+                    break;
+                case 'p':
+                    AppendFormatted(out, "\"0x%" PRIx64 "\"", arg.bits);
+                    break;
+                default: AppendJsonString(out, arg.text); break;
+            }
+        }
+        out += ']';
+    }
+    out += ",\"text\":";
+    AppendJsonString(out, record.text);
+    out += '}';
+    return out;
+}
+
+} // namespace QLog
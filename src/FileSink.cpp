@@ -0,0 +1,668 @@
+#include "QLog.h"
+
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <system_error>
+
+#if defined(_WIN32)
+#  ifndef WIN32_LEAN_AND_MEAN
+#    define WIN32_LEAN_AND_MEAN
+#  endif
+#  ifndef NOMINMAX
+#    define NOMINMAX
+#  endif
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+#if defined(__linux__)
+#  include <linux/io_uring.h>
+#  include <sys/mman.h>
+#  include <sys/syscall.h>
+#endif
+
+namespace QLog
+{
+
+namespace
+{
+    // Keeps room for at least one record prefix
+    size_t ClampBufferSize(size_t size)
+    {
+        constexpr size_t kMinBufferSize = 256;
+        return size < kMinBufferSize ? kMinBufferSize : size;
+    }
+
+    [[noreturn]] void ThrowLastError(const char* what)
+    {
+#if defined(_WIN32)
+        throw std::system_error(static_cast<int>(::GetLastError()), std::system_category(), what);
+#else
+        throw std::system_error(errno, std::generic_category(), what);
+#endif
+    }
+
+    // Buffers per FileIo::Async sink: one being filled, the rest in flight or queued
+    constexpr size_t kAsyncBuffers = 3;
+}
+
+// A queue of filled buffers written in order behind the worker's back.
+// Submit() hands one over and returns a free buffer, waiting only when every
+// buffer is still in flight. Write errors are kept for the next CheckError/Drain.
+class FileSink::AsyncWriter
+{
+public:
+    virtual ~AsyncWriter() = default;
+    virtual std::unique_ptr<char[]> Submit(std::unique_ptr<char[]> buffer, size_t size) = 0;
+    // Returns once everything submitted is written
+    virtual void Drain() = 0;
+    // Throws the first write error since the last check
+    virtual void CheckError() = 0;
+};
+
+namespace
+{
+    using Buffer = std::unique_ptr<char[]>;
+
+    // Portable backend: one I/O thread doing the blocking writes
+    class ThreadWriter final : public FileSink::AsyncWriter
+    {
+    public:
+        ThreadWriter(File& file, size_t bufferSize)
+            : m_file(file),
+              m_bufferSize(bufferSize),
+              m_thread([this] { Run(); })
+        {}
+
+        ~ThreadWriter() override
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mtx);
+                m_stop = true;
+            }
+            m_cv.notify_all();
+            m_thread.join();
+        }
+
+        Buffer Submit(Buffer buffer, size_t size) override
+        {
+            std::unique_lock<std::mutex> lock(m_mtx);
+            Buffer spare;
+            if (m_free.empty() && m_allocated < kAsyncBuffers - 1)
+            {
+                // Only when no written buffer is back yet, and before the
+                // handover so a throw loses nothing
+                lock.unlock();
+                spare.reset(new char[m_bufferSize]);
+                lock.lock();
+            }
+            m_queue.emplace_back(std::move(buffer), size);
+            m_cv.notify_all();
+            if (spare)
+            {
+                ++m_allocated;
+                return spare;
+            }
+            m_cv.wait(lock, [&] { return !m_free.empty(); });
+            Buffer next = std::move(m_free.back());
+            m_free.pop_back();
+            return next;
+        }
+
+        void Drain() override
+        {
+            std::unique_lock<std::mutex> lock(m_mtx);
+            m_cv.wait(lock, [&] { return m_queue.empty() && !m_writing; });
+            RethrowError();
+        }
+
+        void CheckError() override
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            RethrowError();
+        }
+
+    private:
+        void RethrowError()
+        {
+            if (m_error)
+            {
+                std::rethrow_exception(std::exchange(m_error, nullptr));
+            }
+        }
+
+        void Run()
+        {
+            std::unique_lock<std::mutex> lock(m_mtx);
+            for (;;)
+            {
+                m_cv.wait(lock, [&] { return m_stop || !m_queue.empty(); });
+                if (m_queue.empty())
+                {
+                    return; // stopping with nothing left to write
+                }
+                auto job = std::move(m_queue.front());
+                m_queue.pop_front();
+                m_writing = true;
+                lock.unlock();
+                std::exception_ptr error;
+                try
+                {
+                    m_file.Write(job.first.get(), job.second);
+                }
+                catch (...)
+                {
+                    error = std::current_exception();
+                }
+                lock.lock();
+                m_writing = false;
+                if (error && !m_error)
+                {
+                    m_error = error;
+                }
+                m_free.push_back(std::move(job.first));
+                m_cv.notify_all();
+            }
+        }
+
+        File& m_file;
+        const size_t m_bufferSize;
+        std::mutex m_mtx;
+        std::condition_variable m_cv;
+        std::deque<std::pair<Buffer, size_t>> m_queue;
+        std::vector<Buffer> m_free;
+        size_t m_allocated{0};
+        bool m_writing{false};
+        bool m_stop{false};
+        std::exception_ptr m_error;
+        std::thread m_thread; // last: starts running in the constructor
+    };
+
+#if defined(__linux__) && defined(IORING_FEAT_RW_CUR_POS)
+    // Linux backend: buffers go to an io_uring one at a time (IORING_OP_WRITE at
+    // the current file position, so O_APPEND files keep their order) and
+    // completions are reaped whenever the worker submits the next buffer.
+    // Uses the raw syscalls, so there is no liburing dependency.
+    class UringWriter final : public FileSink::AsyncWriter
+    {
+    public:
+        UringWriter(File& file, size_t bufferSize)
+            : m_file(file),
+              m_bufferSize(bufferSize)
+        {
+            io_uring_params params{};
+            m_ring = static_cast<int>(::syscall(__NR_io_uring_setup, 4, &params));
+            if (m_ring < 0)
+            {
+                ThrowLastError("QLog: io_uring_setup failed");
+            }
+            if (!(params.features & IORING_FEAT_RW_CUR_POS) || !(params.features & IORING_FEAT_SINGLE_MMAP))
+            {
+                ::close(m_ring);
+                throw std::system_error(std::make_error_code(std::errc::function_not_supported),
+                                        "QLog: io_uring lacks the needed features");
+            }
+            m_ringSize = std::max<size_t>(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+                                          params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+            m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+            void* ring = ::mmap(nullptr, m_ringSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring,
+                                IORING_OFF_SQ_RING);
+            void* sqes = ring == MAP_FAILED ? MAP_FAILED
+                       : ::mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring,
+                                IORING_OFF_SQES);
+            if (sqes == MAP_FAILED)
+            {
+                const int err = errno;
+                if (ring != MAP_FAILED)
+                {
+                    ::munmap(ring, m_ringSize);
+                }
+                ::close(m_ring);
+                throw std::system_error(err, std::generic_category(), "QLog: cannot map io_uring");
+            }
+            m_ringMap = static_cast<char*>(ring);
+            m_sqes = static_cast<io_uring_sqe*>(sqes);
+            m_sqHead = reinterpret_cast<unsigned*>(m_ringMap + params.sq_off.head);
+            m_sqTail = reinterpret_cast<unsigned*>(m_ringMap + params.sq_off.tail);
+            m_sqMask = *reinterpret_cast<unsigned*>(m_ringMap + params.sq_off.ring_mask);
+            m_sqArray = reinterpret_cast<unsigned*>(m_ringMap + params.sq_off.array);
+            m_cqHead = reinterpret_cast<unsigned*>(m_ringMap + params.cq_off.head);
+            m_cqTail = reinterpret_cast<unsigned*>(m_ringMap + params.cq_off.tail);
+            m_cqMask = *reinterpret_cast<unsigned*>(m_ringMap + params.cq_off.ring_mask);
+            m_cqes = reinterpret_cast<io_uring_cqe*>(m_ringMap + params.cq_off.cqes);
+        }
+
+        ~UringWriter() override
+        {
+            try
+            {
+                Drain();
+            }
+            catch (...)
+            {
+            }
+            ::munmap(m_sqes, m_sqesSize);
+            ::munmap(m_ringMap, m_ringSize);
+            ::close(m_ring);
+        }
+
+        Buffer Submit(Buffer buffer, size_t size) override
+        {
+            Reap(false);
+            Buffer spare;
+            if (m_free.empty() && m_allocated < kAsyncBuffers - 1)
+            {
+                // Only when no written buffer is back yet, and before the
+                // handover so a throw loses nothing
+                spare.reset(new char[m_bufferSize]);
+            }
+            m_pending.emplace_back(std::move(buffer), size);
+            StartNext();
+            if (spare)
+            {
+                ++m_allocated;
+                return spare;
+            }
+            while (m_free.empty())
+            {
+                Reap(true);
+            }
+            Buffer next = std::move(m_free.back());
+            m_free.pop_back();
+            return next;
+        }
+
+        void Drain() override
+        {
+            while (m_inFlight.first || !m_pending.empty())
+            {
+                Reap(true);
+            }
+            CheckError();
+        }
+
+        void CheckError() override
+        {
+            if (m_error != 0)
+            {
+                const int err = std::exchange(m_error, 0);
+                throw std::system_error(err, std::generic_category(), "QLog: log file write failed");
+            }
+        }
+
+        void StartNext()
+        {
+            if (!m_inFlight.first && !m_pending.empty())
+            {
+                m_inFlight = std::move(m_pending.front());
+                m_pending.pop_front();
+                m_written = 0;
+                StartWrite();
+            }
+        }
+
+        void StartWrite()
+        {
+            const size_t left = m_inFlight.second - m_written;
+            if (m_broken)
+            {
+                // The ring failed once; finish on the calling thread instead
+                try
+                {
+                    m_file.Write(m_inFlight.first.get() + m_written, left);
+                }
+                catch (const std::system_error& e)
+                {
+                    m_error = e.code().value();
+                }
+                Finish();
+                return;
+            }
+            const unsigned tail = *m_sqTail; // only this thread produces
+            const unsigned index = tail & m_sqMask;
+            io_uring_sqe& sqe = m_sqes[index];
+            std::memset(&sqe, 0, sizeof(sqe));
+            sqe.opcode = IORING_OP_WRITE;
+            sqe.fd = static_cast<int>(m_file.NativeHandle());
+            sqe.addr = reinterpret_cast<std::uintptr_t>(m_inFlight.first.get() + m_written);
+            sqe.len = static_cast<std::uint32_t>(std::min<size_t>(left, 1u << 30));
+            sqe.off = ~std::uint64_t{0}; // current position
+            m_sqArray[index] = index;
+            __atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+            long rc;
+            do
+            {
+                rc = ::syscall(__NR_io_uring_enter, m_ring, 1, 0, 0, nullptr, 0);
+            } while (rc < 0 && errno == EINTR);
+            if (rc != 1)
+            {
+                if (__atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE) != tail + 1)
+                {
+                    // Not consumed: take it back, or a later enter could
+                    // still submit it behind the synchronous rewrite
+                    __atomic_store_n(m_sqTail, tail, __ATOMIC_RELEASE);
+                    m_broken = true;
+                    StartWrite();
+                    return;
+                }
+                m_broken = true; // in flight after all; later writes go synchronous
+            }
+        }
+
+        // Consumes available completions; with `wait`, blocks for at least one if a write is in flight
+        void Reap(bool wait)
+        {
+            for (;;)
+            {
+                const unsigned head = *m_cqHead;
+                if (head != __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE))
+                {
+                    const int res = m_cqes[head & m_cqMask].res;
+                    __atomic_store_n(m_cqHead, head + 1, __ATOMIC_RELEASE);
+                    Complete(res);
+                    wait = false;
+                    continue;
+                }
+                if (!wait || !m_inFlight.first)
+                {
+                    return;
+                }
+                if (::syscall(__NR_io_uring_enter, m_ring, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 &&
+                    errno != EINTR)
+                {
+                    Abandon(errno);
+                    return;
+                }
+            }
+        }
+
+        // The ring cannot report the in-flight write any more. Its outcome is
+        // unknown, so it is neither retried (it may land twice) nor its buffer
+        // reused (the kernel may still read it); the error surfaces on the
+        // next check and later buffers are written synchronously.
+        void Abandon(int err)
+        {
+            m_broken = true;
+            m_error = err;
+            m_abandoned.push_back(std::move(m_inFlight.first));
+            m_inFlight.second = 0;
+            m_free.emplace_back(new char[m_bufferSize]);
+            StartNext();
+        }
+
+        void Complete(int res)
+        {
+            if (res == -EINTR || res == -EAGAIN)
+            {
+                StartWrite(); // retry the same range
+                return;
+            }
+            if (res <= 0)
+            {
+                // Dropped rather than retried forever, like the synchronous path
+                m_error = res < 0 ? -res : EIO;
+                Finish();
+                return;
+            }
+            m_written += static_cast<size_t>(res);
+            if (m_written < m_inFlight.second)
+            {
+                StartWrite(); // short write: the rest goes next, still ahead of later buffers
+                return;
+            }
+            Finish();
+        }
+
+        void Finish()
+        {
+            m_free.push_back(std::move(m_inFlight.first));
+            m_inFlight.second = 0;
+            StartNext();
+        }
+
+        File& m_file;
+        const size_t m_bufferSize;
+        int m_ring{-1};
+        char* m_ringMap{nullptr};
+        size_t m_ringSize{0};
+        io_uring_sqe* m_sqes{nullptr};
+        size_t m_sqesSize{0};
+        unsigned* m_sqHead{nullptr};
+        unsigned* m_sqTail{nullptr};
+        unsigned m_sqMask{0};
+        unsigned* m_sqArray{nullptr};
+        unsigned* m_cqHead{nullptr};
+        unsigned* m_cqTail{nullptr};
+        unsigned m_cqMask{0};
+        io_uring_cqe* m_cqes{nullptr};
+
+        std::deque<std::pair<Buffer, size_t>> m_pending;
+        std::pair<Buffer, size_t> m_inFlight;
+        size_t m_written{0};
+        std::vector<Buffer> m_free;
+        std::vector<Buffer> m_abandoned; // possibly still read by the kernel; freed with the ring
+        size_t m_allocated{0};
+        int m_error{0};
+        bool m_broken{false};
+    };
+#endif
+
+    std::unique_ptr<FileSink::AsyncWriter> MakeAsyncWriter(File& file, size_t bufferSize, FileIo io)
+    {
+#if defined(__linux__) && defined(IORING_FEAT_RW_CUR_POS)
+        if (io == FileIo::Async)
+        {
+            try
+            {
+                return std::make_unique<UringWriter>(file, bufferSize);
+            }
+            catch (const std::system_error&)
+            {
+                // io_uring disabled (seccomp, old kernel, sysctl): fall back to a thread
+            }
+        }
+#else
+        (void)io;
+#endif
+        return std::make_unique<ThreadWriter>(file, bufferSize);
+    }
+}
+
+File::File(const std::string& path, bool truncate)
+{
+#if defined(_WIN32)
+    HANDLE h = ::CreateFileA(path.c_str(), truncate ? GENERIC_WRITE : FILE_APPEND_DATA,
+                             FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+                             truncate ? CREATE_ALWAYS : OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (h == INVALID_HANDLE_VALUE)
+    {
+        ThrowLastError("QLog: cannot open log file");
+    }
+    m_handle = reinterpret_cast<std::intptr_t>(h);
+#else
+    const int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (truncate ? O_TRUNC : O_APPEND);
+    int fd;
+    do
+    {
+        fd = ::open(path.c_str(), flags, 0644);
+    } while (fd < 0 && errno == EINTR);
+    if (fd < 0)
+    {
+        ThrowLastError("QLog: cannot open log file");
+    }
+    m_handle = fd;
+#endif
+}
+
+File::~File()
+{
+    Close();
+}
+
+File::File(File&& other) noexcept
+    : m_handle(other.m_handle)
+{
+    other.m_handle = kInvalid;
+}
+
+File& File::operator=(File&& other) noexcept
+{
+    if (this != &other)
+    {
+        Close();
+        m_handle = other.m_handle;
+        other.m_handle = kInvalid;
+    }
+    return *this;
+}
+
+void File::Write(const char* data, size_t size)
+{
+    while (size > 0)
+    {
+#if defined(_WIN32)
+        const DWORD chunk = size > 0x40000000u ? 0x40000000u : static_cast<DWORD>(size);
+        DWORD written = 0;
+        if (!::WriteFile(reinterpret_cast<HANDLE>(m_handle), data, chunk, &written, nullptr))
+        {
+            ThrowLastError("QLog: log file write failed");
+        }
+#else
+        const ssize_t written = ::write(static_cast<int>(m_handle), data, size);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            ThrowLastError("QLog: log file write failed");
+        }
+#endif
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+}
+
+void File::Close()
+{
+    if (m_handle == kInvalid)
+    {
+        return;
+    }
+#if defined(_WIN32)
+    ::CloseHandle(reinterpret_cast<HANDLE>(m_handle));
+#else
+    ::close(static_cast<int>(m_handle));
+#endif
+    m_handle = kInvalid;
+}
+
+FileSink::FileSink(const std::string& path, size_t bufferSize, bool truncate, FileIo io)
+    : m_file(path, truncate),
+      m_buffer(new char[ClampBufferSize(bufferSize)]),
+      m_bufferSize(ClampBufferSize(bufferSize))
+{
+    if (io != FileIo::Sync)
+    {
+        m_async = MakeAsyncWriter(m_file, m_bufferSize, io);
+    }
+}
+
+FileSink::~FileSink()
+{
+    try
+    {
+        WriteBuffer();
+        if (m_async)
+        {
+            m_async->Drain();
+        }
+    }
+    catch (...)
+    {
+    }
+}
+
+void FileSink::Write(const Message& message)
+{
+    Append(message);
+}
+
+void FileSink::WriteBatch(const Message* messages, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        Append(messages[i]);
+    }
+}
+
+void FileSink::Flush()
+{
+    WriteBuffer();
+    if (m_async)
+    {
+        m_async->Drain();
+    }
+}
+
+File FileSink::ReplaceFile(File file)
+{
+    // The old file must be complete before it is handed back
+    Flush();
+    File previous = std::move(m_file);
+    m_file = std::move(file);
+    m_bytesWritten = 0;
+    return previous;
+}
+
+void FileSink::Append(const Message& message)
+{
+    const size_t bound = MaxRecordSize(message);
+    if (m_used + bound > m_bufferSize)
+    {
+        WriteBuffer();
+    }
+    if (bound <= m_bufferSize)
+    {
+        const size_t len = FormatRecord(message, m_buffer.get() + m_used);
+        m_used += len;
+        m_bytesWritten += len;
+        return;
+    }
+
+    // Larger than the whole buffer: write prefix, text and newline directly
+    Message prefixOnly = message;
+    prefixOnly.text = std::string_view{};
+    const size_t prefixLen = FormatRecord(prefixOnly, m_buffer.get()) - 1; // without '\n'
+    if (m_async)
+    {
+        m_async->Drain(); // keep the direct writes behind the queued buffers
+    }
+    m_file.Write(m_buffer.get(), prefixLen);
+    m_file.Write(message.text.data(), message.text.size());
+    m_file.Write("\n", 1);
+    m_bytesWritten += prefixLen + message.text.size() + 1;
+}
+
+void FileSink::WriteBuffer()
+{
+    if (m_used == 0)
+    {
+        return;
+    }
+    const size_t used = m_used;
+    m_used = 0; // on failure the buffered records are dropped rather than retried forever
+    if (m_async)
+    {
+        m_buffer = m_async->Submit(std::move(m_buffer), used);
+        m_async->CheckError();
+        return;
+    }
+    m_file.Write(m_buffer.get(), used);
+}
+
+} // namespace QLog
@@ -0,0 +1,227 @@
+#include "QLog.h"
+
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <system_error>
+
+#if defined(_WIN32)
+#  ifndef WIN32_LEAN_AND_MEAN
+#    define WIN32_LEAN_AND_MEAN
+#  endif
+#  ifndef NOMINMAX
+#    define NOMINMAX
+#  endif
+#  include <windows.h>
+#else
+#  include <cerrno>
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+namespace QLog
+{
+
+namespace
+{
+    constexpr char kRingMagic[8] = {'Q', 'L', 'O', 'G', 'R', 'I', 'N', 'G'};
+    constexpr std::uint32_t kRingVersion = 1;
+
+    // On-disk header; the ring data follows at kRingHeaderSize
+    struct RingFileHeader
+    {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t headerSize;
+        std::uint64_t capacity;
+        std::uint64_t cursor; // total bytes written; data[cursor % capacity] is the next byte
+    };
+    constexpr size_t kRingHeaderSize = 64;
+    static_assert(sizeof(RingFileHeader) <= kRingHeaderSize, "ring header must fit its reserved space");
+
+    [[noreturn]] void ThrowLastError(const char* what)
+    {
+#if defined(_WIN32)
+        throw std::system_error(static_cast<int>(::GetLastError()), std::system_category(), what);
+#else
+        throw std::system_error(errno, std::generic_category(), what);
+#endif
+    }
+}
+
+MappedRingFileSink::MappedRingFileSink(const std::string& path, size_t capacity)
+    : m_viewSize(kRingHeaderSize + capacity),
+      m_capacity(capacity)
+{
+    if (capacity == 0)
+    {
+        throw std::invalid_argument("QLog: ring file capacity must be non-zero");
+    }
+#if defined(_WIN32)
+    HANDLE file = ::CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+                                OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        ThrowLastError("QLog: cannot open ring file");
+    }
+    const auto size = static_cast<std::uint64_t>(m_viewSize);
+    HANDLE mapping = ::CreateFileMappingA(file, nullptr, PAGE_READWRITE,
+                                          static_cast<DWORD>(size >> 32), static_cast<DWORD>(size), nullptr);
+    void* view = mapping ? ::MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, m_viewSize) : nullptr;
+    if (!view)
+    {
+        const DWORD err = ::GetLastError();
+        if (mapping)
+        {
+            ::CloseHandle(mapping);
+        }
+        ::CloseHandle(file);
+        throw std::system_error(static_cast<int>(err), std::system_category(), "QLog: cannot map ring file");
+    }
+    m_file = reinterpret_cast<std::intptr_t>(file);
+    m_mapping = reinterpret_cast<std::intptr_t>(mapping);
+#else
+    const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        ThrowLastError("QLog: cannot open ring file");
+    }
+    struct stat st{};
+    if (::fstat(fd, &st) != 0 ||
+        (static_cast<size_t>(st.st_size) != m_viewSize && ::ftruncate(fd, static_cast<off_t>(m_viewSize)) != 0))
+    {
+        const int err = errno;
+        ::close(fd);
+        throw std::system_error(err, std::generic_category(), "QLog: cannot size ring file");
+    }
+    void* view = ::mmap(nullptr, m_viewSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (view == MAP_FAILED)
+    {
+        const int err = errno;
+        ::close(fd);
+        throw std::system_error(err, std::generic_category(), "QLog: cannot map ring file");
+    }
+    m_file = fd;
+#endif
+    m_view = static_cast<char*>(view);
+    m_data = m_view + kRingHeaderSize;
+
+    // Continue an existing ring of the same geometry, otherwise start fresh
+    RingFileHeader header{};
+    std::memcpy(&header, m_view, sizeof(header));
+    if (std::memcmp(header.magic, kRingMagic, sizeof(kRingMagic)) == 0 && header.version == kRingVersion &&
+        header.headerSize == kRingHeaderSize && header.capacity == m_capacity)
+    {
+        m_cursor = header.cursor;
+    }
+    else
+    {
+        std::memcpy(header.magic, kRingMagic, sizeof(kRingMagic));
+        header.version = kRingVersion;
+        header.headerSize = static_cast<std::uint32_t>(kRingHeaderSize);
+        header.capacity = m_capacity;
+        header.cursor = 0;
+        std::memcpy(m_view, &header, sizeof(header));
+    }
+}
+
+MappedRingFileSink::~MappedRingFileSink()
+{
+#if defined(_WIN32)
+    ::UnmapViewOfFile(m_view);
+    ::CloseHandle(reinterpret_cast<HANDLE>(m_mapping));
+    ::CloseHandle(reinterpret_cast<HANDLE>(m_file));
+#else
+    ::munmap(m_view, m_viewSize);
+    ::close(static_cast<int>(m_file));
+#endif
+}
+
+void MappedRingFileSink::Write(const Message& message)
+{
+    Append(message);
+}
+
+void MappedRingFileSink::WriteBatch(const Message* messages, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        Append(messages[i]);
+    }
+}
+
+void MappedRingFileSink::Append(const Message& message)
+{
+    const size_t bound = MaxRecordSize(message);
+    const size_t offset = static_cast<size_t>(m_cursor % m_capacity);
+    if (bound <= m_capacity - offset)
+    {
+        // Common case: format straight into the mapping
+        m_cursor += FormatRecord(message, m_data + offset);
+    }
+    else
+    {
+        if (m_scratch.size() < bound)
+        {
+            m_scratch.resize(bound);
+        }
+        CopyIn(m_scratch.data(), FormatRecord(message, m_scratch.data()));
+    }
+    // Publish the cursor only after the record bytes are in place
+    std::memcpy(m_view + offsetof(RingFileHeader, cursor), &m_cursor, sizeof(m_cursor));
+}
+
+void MappedRingFileSink::CopyIn(const char* data, size_t size)
+{
+    if (size > m_capacity)
+    {
+        // Only the tail of an oversized record can survive anyway
+        m_cursor += size - m_capacity;
+        data += size - m_capacity;
+        size = m_capacity;
+    }
+    const size_t offset = static_cast<size_t>(m_cursor % m_capacity);
+    const size_t first = size < m_capacity - offset ? size : m_capacity - offset;
+    std::memcpy(m_data + offset, data, first);
+    std::memcpy(m_data, data + first, size - first);
+    m_cursor += size;
+}
+
+bool ReadRingFile(const std::string& path, std::string& out)
+{
+    std::ifstream in(path, std::ios::binary);
+    RingFileHeader header{};
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, kRingMagic, sizeof(kRingMagic)) != 0 || header.version != kRingVersion ||
+        header.capacity == 0)
+    {
+        return false;
+    }
+
+    std::string data(static_cast<size_t>(header.capacity), '\0');
+    in.seekg(static_cast<std::streamoff>(header.headerSize));
+    if (!in.read(data.data(), static_cast<std::streamsize>(data.size())))
+    {
+        return false;
+    }
+
+    out.clear();
+    if (header.cursor <= header.capacity)
+    {
+        out.assign(data, 0, static_cast<size_t>(header.cursor));
+        return true;
+    }
+    // Wrapped: oldest byte sits at the cursor; drop the partially overwritten first record
+    const auto start = static_cast<size_t>(header.cursor % header.capacity);
+    out.reserve(data.size());
+    out.append(data, start, std::string::npos);
+    out.append(data, 0, start);
+    const auto firstNewline = out.find('\n');
+    out.erase(0, firstNewline == std::string::npos ? out.size() : firstNewline + 1);
+    return true;
+}
+
+} // namespace QLog
@@ -0,0 +1,148 @@
+#include "QLog.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#  include <io.h>
+#else
+#  include <cerrno>
+#  include <unistd.h>
+#endif
+
+namespace QLog
+{
+
+namespace
+{
+    // FormatRecord's worst case beyond the text itself
+    constexpr size_t kRecordOverhead = kTimestampBufferSize + 16;
+
+    bool WriteAll(int fd, const char* data, size_t size)
+    {
+        while (size != 0)
+        {
+#if defined(_WIN32)
+            const int n = ::_write(fd, data, static_cast<unsigned>(std::min<size_t>(size, 1u << 30)));
+            if (n <= 0)
+            {
+                return false;
+            }
+#else
+            const ssize_t n = ::write(fd, data, size);
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                return false;
+            }
+#endif
+            data += n;
+            size -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+}
+
+MemoryRingSink::MemoryRingSink(size_t records, size_t slotSize)
+    : m_slots(records),
+      m_slotSize(slotSize)
+{
+    if (records == 0 || slotSize <= kRecordOverhead)
+    {
+        throw std::invalid_argument("QLog: MemoryRingSink needs records > 0 and slots over 48 bytes");
+    }
+    m_data.reset(new char[records * slotSize]);
+    m_lengths.reset(new std::uint32_t[records]());
+}
+
+void MemoryRingSink::Write(const Message& message)
+{
+    std::lock_guard<std::mutex> lock(m_mtx);
+    Append(message);
+}
+
+void MemoryRingSink::WriteBatch(const Message* messages, size_t count)
+{
+    std::lock_guard<std::mutex> lock(m_mtx);
+    for (size_t i = 0; i < count; ++i)
+    {
+        Append(messages[i]);
+    }
+}
+
+void MemoryRingSink::Append(const Message& message)
+{
+    const std::uint64_t n = m_written.load(std::memory_order_relaxed);
+    const size_t index = static_cast<size_t>(n % m_slots);
+    Message fitted = message;
+    fitted.text = fitted.text.substr(0, std::min(fitted.text.size(), m_slotSize - kRecordOverhead));
+    m_lengths[index] = static_cast<std::uint32_t>(FormatRecord(fitted, m_data.get() + index * m_slotSize));
+    // Publishes the slot to DumpTo, which reads without the lock
+    m_written.store(n + 1, std::memory_order_release);
+}
+
+std::string MemoryRingSink::Text() const
+{
+    std::lock_guard<std::mutex> lock(m_mtx);
+    const std::uint64_t written = m_written.load(std::memory_order_relaxed);
+    std::string text;
+    for (std::uint64_t n = written > m_slots ? written - m_slots : 0; n < written; ++n)
+    {
+        const size_t index = static_cast<size_t>(n % m_slots);
+        text.append(m_data.get() + index * m_slotSize, m_lengths[index]);
+    }
+    return text;
+}
+
+std::vector<std::string> MemoryRingSink::Lines() const
+{
+    std::lock_guard<std::mutex> lock(m_mtx);
+    const std::uint64_t written = m_written.load(std::memory_order_relaxed);
+    std::vector<std::string> lines;
+    for (std::uint64_t n = written > m_slots ? written - m_slots : 0; n < written; ++n)
+    {
+        const size_t index = static_cast<size_t>(n % m_slots);
+        const size_t length = m_lengths[index];
+        // Without the newline FormatRecord ends each record with
+        lines.emplace_back(m_data.get() + index * m_slotSize, length != 0 ? length - 1 : 0);
+    }
+    return lines;
+}
+
+size_t MemoryRingSink::Size() const
+{
+    return static_cast<size_t>(std::min<std::uint64_t>(m_written.load(std::memory_order_relaxed), m_slots));
+}
+
+std::uint64_t MemoryRingSink::Written() const
+{
+    return m_written.load(std::memory_order_relaxed);
+}
+
+void MemoryRingSink::Clear()
+{
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_written.store(0, std::memory_order_release);
+}
+
+size_t MemoryRingSink::DumpTo(int fd) const
+{
+    const std::uint64_t written = m_written.load(std::memory_order_acquire);
+    size_t total = 0;
+    for (std::uint64_t n = written > m_slots ? written - m_slots : 0; n < written; ++n)
+    {
+        const size_t index = static_cast<size_t>(n % m_slots);
+        const size_t length = std::min<size_t>(m_lengths[index], m_slotSize);
+        if (!WriteAll(fd, m_data.get() + index * m_slotSize, length))
+        {
+            break;
+        }
+        total += length;
+    }
+    return total;
+}
+
+} // namespace QLog
@@ -0,0 +1,387 @@
+#include "QLog.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+#if !defined(_WIN32)
+#  include <cerrno>
+#  include <fcntl.h>
+#  include <netdb.h>
+#  include <poll.h>
+#  include <sys/socket.h>
+#  include <sys/uio.h>
+#  include <sys/un.h>
+#  include <unistd.h>
+#endif
+
+namespace QLog
+{
+
+#if defined(_WIN32)
+
+NetworkSink::NetworkSink(const std::string&, const NetworkSinkOptions& options)
+    : m_options(options),
+      m_blockSize(0),
+      m_backoff(options.reconnectMin)
+{
+    throw std::system_error(std::make_error_code(std::errc::not_supported), "QLog: NetworkSink needs POSIX sockets");
+}
+
+NetworkSink::~NetworkSink() = default;
+void NetworkSink::Write(const Message&) {}
+void NetworkSink::WriteBatch(const Message*, size_t) {}
+void NetworkSink::Flush() {}
+
+#else
+
+namespace
+{
+    // Iovecs handed to one sendmsg call
+    constexpr int kMaxIov = 64;
+
+    // Spill blocks: large enough to batch well, small enough that dropping the
+    // oldest one loses little
+    size_t SpillBlockSize(size_t capacity)
+    {
+        return std::clamp<size_t>(capacity / 8, 4 * 1024, 64 * 1024);
+    }
+
+#if defined(MSG_NOSIGNAL)
+    constexpr int kSendFlags = MSG_NOSIGNAL;
+#else
+    constexpr int kSendFlags = 0;
+#endif
+}
+
+NetworkSink::NetworkSink(const std::string& address, const NetworkSinkOptions& options)
+    : m_options(options),
+      m_blockSize(SpillBlockSize(options.spillCapacity)),
+      m_backoff(options.reconnectMin)
+{
+    if (address.rfind("unix:", 0) == 0)
+    {
+        const std::string path = address.substr(5);
+        sockaddr_un un{};
+        if (path.empty() || path.size() >= sizeof(un.sun_path))
+        {
+            throw std::invalid_argument("QLog: bad unix socket path in " + address);
+        }
+        un.sun_family = AF_UNIX;
+        std::memcpy(un.sun_path, path.c_str(), path.size() + 1);
+        m_family = AF_UNIX;
+        m_address.assign(reinterpret_cast<const char*>(&un), reinterpret_cast<const char*>(&un) + sizeof(un));
+    }
+    else if (address.rfind("tcp:", 0) == 0)
+    {
+        const auto colon = address.rfind(':');
+        std::string host = address.substr(4, colon - 4);
+        const std::string port = address.substr(colon + 1);
+        if (colon < 4 || host.empty() || port.empty())
+        {
+            throw std::invalid_argument("QLog: expected tcp:host:port, got " + address);
+        }
+        if (host.front() == '[' && host.back() == ']')
+        {
+            host = host.substr(1, host.size() - 2); // [::1]
+        }
+        // Resolved once here, so reconnecting never blocks on DNS
+        addrinfo hints{};
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* result = nullptr;
+        const int rc = ::getaddrinfo(host.c_str(), port.c_str(), &hints, &result);
+        if (rc != 0 || !result)
+        {
+            throw std::system_error(std::make_error_code(std::errc::host_unreachable),
+                                    "QLog: cannot resolve " + address + ": " + ::gai_strerror(rc));
+        }
+        m_family = result->ai_family;
+        m_address.assign(reinterpret_cast<const char*>(result->ai_addr),
+                         reinterpret_cast<const char*>(result->ai_addr) + result->ai_addrlen);
+        ::freeaddrinfo(result);
+    }
+    else
+    {
+        throw std::invalid_argument("QLog: unsupported network address " + address);
+    }
+    StartConnect(std::chrono::steady_clock::now());
+}
+
+NetworkSink::~NetworkSink()
+{
+    // Last chance for records the worker handed over during shutdown
+    try
+    {
+        Service();
+    }
+    catch (...)
+    {
+    }
+    if (m_socket >= 0)
+    {
+        ::close(static_cast<int>(m_socket));
+    }
+}
+
+void NetworkSink::Write(const Message& message)
+{
+    Append(message);
+    TrimSpill();
+    Service();
+}
+
+void NetworkSink::WriteBatch(const Message* messages, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        Append(messages[i]);
+    }
+    TrimSpill();
+    Service();
+}
+
+void NetworkSink::Flush()
+{
+    Service();
+    const auto deadline = std::chrono::steady_clock::now() + m_options.flushTimeout;
+    while (m_spilled != 0 && std::chrono::steady_clock::now() < deadline)
+    {
+        WaitWritable(deadline);
+        Service();
+    }
+}
+
+void NetworkSink::Append(const Message& message)
+{
+    if (m_blocks.empty() || m_blocks.back().data.size() >= m_blockSize)
+    {
+        m_blocks.emplace_back().data.reserve(m_blockSize + kTimestampBufferSize + 64);
+    }
+    Block& block = m_blocks.back();
+    const std::string_view text = RenderText(message, m_scratch);
+    Message rendered = message;
+    rendered.text = text;
+    rendered.render = nullptr;
+    const size_t offset = block.data.size();
+    block.data.resize(offset + MaxRecordSize(rendered));
+    block.data.resize(offset + FormatRecord(rendered, block.data.data() + offset));
+    ++block.records;
+    m_spilled += block.data.size() - offset;
+}
+
+void NetworkSink::TrimSpill()
+{
+    // Drop the oldest whole blocks, but never one that is partly on the wire
+    // (the stream would be cut mid-record) or the one still being filled
+    const size_t first = m_sentOffset != 0 ? 1 : 0;
+    while (m_spilled > m_options.spillCapacity && m_blocks.size() > first + 1)
+    {
+        m_spilled -= m_blocks[first].data.size();
+        m_recordsDropped.fetch_add(m_blocks[first].records, std::memory_order_relaxed);
+        m_blocks.erase(m_blocks.begin() + static_cast<std::ptrdiff_t>(first));
+    }
+    m_spilledBytes.store(m_spilled, std::memory_order_relaxed);
+}
+
+void NetworkSink::Service()
+{
+    const auto now = std::chrono::steady_clock::now();
+    if (m_state == State::Disconnected && now >= m_nextAttempt)
+    {
+        StartConnect(now);
+    }
+    if (m_state == State::Connecting)
+    {
+        FinishConnect(now);
+    }
+    if (m_state == State::Connected)
+    {
+        Send();
+    }
+    m_spilledBytes.store(m_spilled, std::memory_order_relaxed);
+}
+
+void NetworkSink::StartConnect(std::chrono::steady_clock::time_point now)
+{
+    const int fd = ::socket(m_family, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        Disconnect(now);
+        return;
+    }
+    ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+    ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+#if defined(SO_NOSIGPIPE)
+    const int on = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+    m_socket = fd;
+    m_connectStarted = now;
+    if (::connect(fd, reinterpret_cast<const sockaddr*>(m_address.data()),
+                  static_cast<socklen_t>(m_address.size())) == 0)
+    {
+        m_state = State::Connected;
+    }
+    else if (errno == EINPROGRESS)
+    {
+        m_state = State::Connecting;
+        return;
+    }
+    else
+    {
+        Disconnect(now);
+        return;
+    }
+    m_backoff = m_options.reconnectMin;
+    m_connects.fetch_add(1, std::memory_order_relaxed);
+    m_connected.store(true, std::memory_order_relaxed);
+}
+
+void NetworkSink::FinishConnect(std::chrono::steady_clock::time_point now)
+{
+    pollfd pfd{static_cast<int>(m_socket), POLLOUT, 0};
+    if (::poll(&pfd, 1, 0) == 0)
+    {
+        if (now - m_connectStarted > m_options.reconnectMax)
+        {
+            Disconnect(now); // give up on a handshake that is not going anywhere
+        }
+        return;
+    }
+    int error = 0;
+    socklen_t length = sizeof(error);
+    if (::getsockopt(static_cast<int>(m_socket), SOL_SOCKET, SO_ERROR, &error, &length) != 0 || error != 0)
+    {
+        Disconnect(now);
+        return;
+    }
+    m_state = State::Connected;
+    m_backoff = m_options.reconnectMin;
+    m_connects.fetch_add(1, std::memory_order_relaxed);
+    m_connected.store(true, std::memory_order_relaxed);
+}
+
+void NetworkSink::Send()
+{
+    while (!m_blocks.empty() && m_spilled != 0)
+    {
+        iovec iov[kMaxIov];
+        int count = 0;
+        for (auto it = m_blocks.begin(); it != m_blocks.end() && count < kMaxIov; ++it)
+        {
+            const size_t skip = count == 0 ? m_sentOffset : 0;
+            if (it->data.size() > skip)
+            {
+                iov[count].iov_base = it->data.data() + skip;
+                iov[count].iov_len = it->data.size() - skip;
+                ++count;
+            }
+        }
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = static_cast<decltype(msg.msg_iovlen)>(count);
+        const ssize_t sent = ::sendmsg(static_cast<int>(m_socket), &msg, kSendFlags);
+        if (sent < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                Disconnect(std::chrono::steady_clock::now());
+            }
+            return; // socket buffer full: the rest stays spilled
+        }
+        m_bytesSent.fetch_add(static_cast<std::uint64_t>(sent), std::memory_order_relaxed);
+        m_spilled -= static_cast<size_t>(sent);
+        size_t remaining = static_cast<size_t>(sent);
+        while (remaining != 0)
+        {
+            Block& front = m_blocks.front();
+            const size_t left = front.data.size() - m_sentOffset;
+            if (remaining < left)
+            {
+                m_sentOffset += remaining;
+                break;
+            }
+            remaining -= left;
+            m_sentOffset = 0;
+            if (m_blocks.size() == 1)
+            {
+                front.data.clear(); // keep the last block's buffer for the next batch
+                front.records = 0;
+            }
+            else
+            {
+                m_blocks.pop_front();
+            }
+        }
+    }
+}
+
+void NetworkSink::Disconnect(std::chrono::steady_clock::time_point now)
+{
+    if (m_socket >= 0)
+    {
+        ::close(static_cast<int>(m_socket));
+        m_socket = -1;
+    }
+    if (m_state == State::Connected)
+    {
+        m_backoff = m_options.reconnectMin;
+    }
+    m_state = State::Disconnected;
+    m_connected.store(false, std::memory_order_relaxed);
+    if (m_sentOffset != 0)
+    {
+        // Forget the records that made it out. One cut off mid-line is dropped
+        // too: the collector already has its start, so resending it whole on
+        // the new connection would leave a fragment and a duplicate.
+        Block& front = m_blocks.front();
+        size_t end = m_sentOffset;
+        if (front.data[end - 1] != '\n')
+        {
+            const auto newline = front.data.find('\n', end);
+            end = newline == std::string::npos ? front.data.size() : newline + 1;
+            m_spilled -= end - m_sentOffset;
+            m_recordsDropped.fetch_add(1, std::memory_order_relaxed);
+        }
+        const auto records = static_cast<size_t>(std::count(front.data.begin(), front.data.begin() + end, '\n'));
+        front.records -= std::min(front.records, records);
+        front.data.erase(0, end);
+        m_sentOffset = 0;
+        m_spilledBytes.store(m_spilled, std::memory_order_relaxed);
+    }
+    m_nextAttempt = now + m_backoff;
+    m_backoff = std::min(m_backoff * 2, m_options.reconnectMax);
+}
+
+void NetworkSink::WaitWritable(std::chrono::steady_clock::time_point deadline)
+{
+    const auto now = std::chrono::steady_clock::now();
+    if (m_state == State::Disconnected)
+    {
+        std::this_thread::sleep_for(std::min(deadline, m_nextAttempt) - now);
+        return;
+    }
+    const auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count();
+    pollfd pfd{static_cast<int>(m_socket), POLLOUT, 0};
+    ::poll(&pfd, 1, static_cast<int>(std::clamp<long long>(wait, 1, 1000)));
+}
+
+#endif
+
+NetworkSinkStats NetworkSink::GetStats() const
+{
+    NetworkSinkStats stats;
+    stats.bytesSent = m_bytesSent.load(std::memory_order_relaxed);
+    stats.recordsDropped = m_recordsDropped.load(std::memory_order_relaxed);
+    stats.connects = m_connects.load(std::memory_order_relaxed);
+    stats.spilledBytes = m_spilledBytes.load(std::memory_order_relaxed);
+    stats.connected = m_connected.load(std::memory_order_relaxed);
+    return stats;
+}
+
+} // namespace QLog
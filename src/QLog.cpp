@@ -1,17 +1,205 @@
 #include "QLog.h"
 
+#include <algorithm>
 #include <chrono>
 #include <iostream>
+#include <limits>
 #include <iomanip>
 #include <cstring>
 #include <cstdarg>
 #include <csignal>
+#include <exception>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#  include <io.h>
+#else
+#  include <cerrno>
+#  include <unistd.h>
+#endif
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#  include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#  include <x86intrin.h>
+#endif
 
 namespace QLog
 {
 
 namespace
 {
+    // Empty polls WaitStrategy::SpinThenPark makes before parking the worker
+    constexpr int kWorkerSpins = 20000;
+
+    std::atomic<std::uint64_t> s_nextLoggerId{1};
+
+    // Batches a LogBackend thread drains from one Logger before moving on
+    constexpr size_t kBackendBatches = 4;
+
+    // The Logger whose worker step is running on this thread, if any
+    thread_local const Logger* t_workerOf = nullptr;
+
+    // Bumps a counter that is only written under a lock, publishing it to
+    // readers outside the lock without an atomic read-modify-write
+    void BumpGuarded(std::atomic<size_t>& counter)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Keeps a Locked queue change (made under m_mtx) marked as in progress with
+    // an odd epoch, so EmergencyDrain, which cannot take the lock, skips it
+    class QueueChange
+    {
+    public:
+        explicit QueueChange(std::atomic<size_t>& epoch)
+            : m_epoch(epoch)
+        {
+            BumpGuarded(m_epoch);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+        ~QueueChange()
+        {
+            BumpGuarded(m_epoch);
+        }
+
+        QueueChange(const QueueChange&) = delete;
+        QueueChange& operator=(const QueueChange&) = delete;
+
+    private:
+        std::atomic<size_t>& m_epoch;
+    };
+
+    // Loggers created with LoggerOptions::crashDrain (defined with the crash handler)
+    void RegisterCrashLogger(Logger* logger);
+    void UnregisterCrashLogger(Logger* logger);
+
+    // Stat shard of the calling thread; threads are spread round-robin
+    std::atomic<size_t> s_nextStatSlot{0};
+    thread_local const size_t t_statSlot = s_nextStatSlot.fetch_add(1, std::memory_order_relaxed);
+
+    // How often the worker re-anchors tick clocks to system_clock
+    constexpr auto kClockCalibrationInterval = std::chrono::seconds(1);
+
+    std::int64_t SystemNowNs()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    std::uint64_t SteadyTicks()
+    {
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    constexpr bool kHasCounter =
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86) || defined(__aarch64__)
+        true;
+#else
+        false;
+#endif
+
+    inline std::uint64_t CounterTicks()
+    {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+        return __rdtsc();
+#elif defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#elif defined(__aarch64__)
+        std::uint64_t value;
+        __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(value));
+        return value;
+#else
+        return SteadyTicks();
+#endif
+    }
+
+    // Text bytes reserved for a record before formatting; the unused end is
+    // handed back to the arena, longer text is formatted again into an exact fit
+    constexpr size_t kTextReserve = 496;
+
+    // Failed pushes Backpressure::SpinThenBlock retries before it waits
+    constexpr int kBackpressureSpins = 2048;
+
+    inline void CpuRelax()
+    {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+        _mm_pause();
+#elif defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        __asm__ __volatile__("yield");
+#else
+        std::this_thread::yield();
+#endif
+    }
+
+    // Most messages the worker hands to Sink::WriteBatch at once
+    constexpr size_t kMaxBatchSize = 256;
+
+    // Renders a deferred record at the end of `buffer`; returns the text length
+    size_t AppendRendered(const Message& message, std::string& buffer)
+    {
+        const size_t offset = buffer.size();
+        size_t room = 128;
+        buffer.resize(offset + room);
+        int len = message.render(message.format, message.args, buffer.data() + offset, room);
+        if (len < 0)
+        {
+            buffer.resize(offset);
+            return 0;
+        }
+        if (static_cast<size_t>(len) >= room)
+        {
+            room = static_cast<size_t>(len) + 1;
+            buffer.resize(offset + room);
+            len = message.render(message.format, message.args, buffer.data() + offset, room);
+        }
+        buffer.resize(offset + static_cast<size_t>(len));
+        return static_cast<size_t>(len);
+    }
+
+    // Renders the batch's deferred records into `buffer` and points their text at it
+    void RenderMessages(std::vector<Message>& batch, std::string& buffer, std::vector<size_t>& offsets)
+    {
+        // Render everything first; views are taken once the buffer stops growing
+        buffer.clear();
+        offsets.clear();
+        for (const auto& msg : batch)
+        {
+            offsets.push_back(buffer.size());
+            if (msg.IsDeferred())
+            {
+                AppendRendered(msg, buffer);
+            }
+        }
+        for (size_t i = 0; i < batch.size(); ++i)
+        {
+            if (batch[i].IsDeferred())
+            {
+                const size_t end = i + 1 < batch.size() ? offsets[i + 1] : buffer.size();
+                batch[i].text = std::string_view(buffer.data() + offsets[i], end - offsets[i]);
+            }
+        }
+    }
+
+    // Records a sink with its own thread may fall behind by before its oldest are dropped
+    constexpr size_t kMaxSinkBacklog = 64 * 1024;
+    // ...or by this many bytes of copied text and arguments
+    constexpr size_t kMaxSinkBacklogBytes = 16u << 20;
+
+    size_t ResolveCapacity(const LoggerOptions& options)
+    {
+        if (options.queueMode != QueueMode::Locked && options.capacity == 0)
+        {
+            return kDefaultRingCapacity;
+        }
+        return options.capacity;
+    }
+
     inline void DebugBreakNow()
     {
 #if defined(_MSC_VER)
@@ -29,6 +217,112 @@ namespace
     }
 }
 
+namespace
+{
+    // Howard Hinnant's days_from_civil inverse: days since 1970-01-01 -> y/m/d
+    void CivilFromDays(std::int64_t z, int& year, unsigned& month, unsigned& day)
+    {
+        z += 719468;
+        const std::int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+        const auto doe = static_cast<unsigned>(z - era * 146097);
+        const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        const unsigned mp = (5 * doy + 2) / 153;
+        day = doy - (153 * mp + 2) / 5 + 1;
+        month = mp < 10 ? mp + 3 : mp - 9;
+        year = static_cast<int>(static_cast<std::int64_t>(yoe) + era * 400 + (month <= 2));
+    }
+
+    void PutDigits(char* out, unsigned value, int width)
+    {
+        for (int i = width - 1; i >= 0; --i)
+        {
+            out[i] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        }
+    }
+
+    std::int64_t FloorDiv(std::int64_t a, std::int64_t b)
+    {
+        return a / b - ((a % b != 0) && ((a < 0) != (b < 0)));
+    }
+}
+
+size_t TimestampFormatter::Format(std::chrono::system_clock::time_point tp, char* out)
+{
+    const auto us = std::chrono::duration_cast<std::chrono::microseconds>(tp.time_since_epoch()).count();
+    const std::int64_t second = FloorDiv(us, 1000000);
+    const auto micros = static_cast<unsigned>(us - second * 1000000);
+
+    if (second != m_second)
+    {
+        Rebuild(second);
+    }
+    std::memcpy(out, m_prefix, kPrefixLength);
+    PutDigits(out + kPrefixLength, micros, 6);
+    out[kPrefixLength + 6] = ']';
+    out[kPrefixLength + 7] = ' ';
+    out[kLength] = '\0';
+    return kLength;
+}
+
+void TimestampFormatter::Rebuild(std::int64_t second)
+{
+    // Local offset is looked up once per quarter hour (the granularity of real
+    // DST transitions) rather than per record
+    constexpr std::int64_t kOffsetBlock = 15 * 60;
+    const std::int64_t block = FloorDiv(second, kOffsetBlock);
+    if (block != m_offsetBlock)
+    {
+        std::time_t t = static_cast<std::time_t>(block * kOffsetBlock);
+        std::tm local{};
+        std::tm utc{};
+#if defined(_WIN32)
+        localtime_s(&local, &t);
+        gmtime_s(&utc, &t);
+#else
+        localtime_r(&t, &local);
+        gmtime_r(&t, &utc);
+#endif
+        // Offset = local wall time - UTC wall time for the same instant
+        const std::int64_t dayDelta = local.tm_year != utc.tm_year ? (local.tm_year > utc.tm_year ? 1 : -1)
+                                                                    : local.tm_yday - utc.tm_yday;
+        m_utcOffset = dayDelta * 86400 + (local.tm_hour - utc.tm_hour) * 3600 + (local.tm_min - utc.tm_min) * 60 +
+                      (local.tm_sec - utc.tm_sec);
+        m_offsetBlock = block;
+    }
+
+    const std::int64_t localSecond = second + m_utcOffset;
+    const std::int64_t days = FloorDiv(localSecond, 86400);
+    const auto secOfDay = static_cast<unsigned>(localSecond - days * 86400);
+    int year;
+    unsigned month;
+    unsigned day;
+    CivilFromDays(days, year, month, day);
+
+    char* p = m_prefix;
+    *p++ = '[';
+    PutDigits(p, static_cast<unsigned>(year), 4);
+    p += 4;
+    *p++ = '-';
+    PutDigits(p, month, 2);
+    p += 2;
+    *p++ = '-';
+    PutDigits(p, day, 2);
+    p += 2;
+    *p++ = ' ';
+    PutDigits(p, secOfDay / 3600, 2);
+    p += 2;
+    *p++ = ':';
+    PutDigits(p, secOfDay / 60 % 60, 2);
+    p += 2;
+    *p++ = ':';
+    PutDigits(p, secOfDay % 60, 2);
+    p += 2;
+    *p++ = '.';
+    m_second = second;
+}
+
 const char* ToString(Level level) noexcept
 {
     switch (level)
@@ -46,27 +340,66 @@ const char* ToString(Level level) noexcept
 
 std::string FormatTimestamp(const Message& message)
 {
-    if (!message.timestamp.has_value()) {
-        return "";
+    char dateTimeBuf[kTimestampBufferSize];
+    const size_t len = FormatTimestamp(message, dateTimeBuf, sizeof(dateTimeBuf));
+    return std::string(dateTimeBuf, len);
+}
+
+size_t FormatTimestamp(const Message& message, char* out, size_t size)
+{
+    if (!message.timestamp.has_value() || size == 0) {
+        return 0;
+    }
+
+    // One formatter per thread: sinks run on the worker, so the cache is hot
+    thread_local TimestampFormatter formatter;
+    if (size > TimestampFormatter::kLength)
+    {
+        return formatter.Format(*message.timestamp, out);
     }
+    char buf[TimestampFormatter::kLength];
+    formatter.Format(*message.timestamp, buf);
+    std::memcpy(out, buf, size - 1);
+    out[size - 1] = '\0';
+    return size - 1;
+}
 
-    const auto tp = *message.timestamp;
-    const auto secs = std::chrono::time_point_cast<std::chrono::seconds>(tp);
-    const auto us = std::chrono::duration_cast<std::chrono::microseconds>(tp - secs).count();
+size_t FormatRecord(const Message& message, char* out)
+{
+    char* p = out + FormatTimestamp(message, out, kTimestampBufferSize);
+    const char* level = ToString(message.level);
+    const size_t levelLen = std::strlen(level);
+    std::memcpy(p, level, levelLen);
+    p += levelLen;
+    *p++ = ':';
+    *p++ = ' ';
+    std::memcpy(p, message.text.data(), message.text.size());
+    p += message.text.size();
+    *p++ = '\n';
+    return static_cast<size_t>(p - out);
+}
 
-    std::time_t t = std::chrono::system_clock::to_time_t(secs);
-    std::tm tm{};
-#if defined(_WIN32)
-    localtime_s(&tm, &t);
-#else
-    localtime_r(&t, &tm);
-#endif
-    char dateTimeBuf[32];
-    std::snprintf(dateTimeBuf, sizeof(dateTimeBuf), "[%04d-%02d-%02d %02d:%02d:%02d.%06d] ",
-                  tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
-                  tm.tm_hour, tm.tm_min, tm.tm_sec, static_cast<int>(us));
+std::string_view RenderText(const Message& message, std::string& buffer)
+{
+    if (!message.IsDeferred())
+    {
+        return message.text;
+    }
+    buffer.clear();
+    const size_t len = AppendRendered(message, buffer);
+    return std::string_view(buffer.data(), len);
+}
 
-    return std::string(dateTimeBuf);
+namespace Detail
+{
+    int FormatInto(char* out, size_t size, const char* format, ...)
+    {
+        va_list args;
+        va_start(args, format);
+        const int len = std::vsnprintf(out, size, format, args);
+        va_end(args);
+        return len;
+    }
 }
 
 OStreamSink::OStreamSink(std::ostream& os)
@@ -75,7 +408,26 @@ OStreamSink::OStreamSink(std::ostream& os)
 
 void OStreamSink::Write(const Message& message)
 {
-    m_os << FormatTimestamp(message) << ToString(message.level) << ": " << message.text << '\n';
+    WriteBatch(&message, 1);
+}
+
+void OStreamSink::WriteBatch(const Message* messages, size_t count)
+{
+    size_t total = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        total += MaxRecordSize(messages[i]);
+    }
+    if (m_buffer.size() < total)
+    {
+        m_buffer.resize(total);
+    }
+    size_t used = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        used += FormatRecord(messages[i], m_buffer.data() + used);
+    }
+    m_os.write(m_buffer.data(), static_cast<std::streamsize>(used));
 }
 
 void OStreamSink::Flush()
@@ -83,18 +435,195 @@ void OStreamSink::Flush()
     m_os.flush();
 }
 
+namespace
+{
+    struct CallSiteRule
+    {
+        std::string file;
+        int line;
+        bool enabled;
+    };
+
+    // Every CallSiteSwitch that has run, and the EnableCallSites history that
+    // sites registering later still have to honor
+    struct CallSiteRegistry
+    {
+        std::mutex mtx;
+        CallSiteSwitch* head{nullptr};
+        std::vector<CallSiteRule> rules;
+    };
+
+    CallSiteRegistry& Registry()
+    {
+        static CallSiteRegistry registry;
+        return registry;
+    }
+
+    bool RuleMatches(const CallSiteRule& rule, const char* file, int line)
+    {
+        if (rule.line != 0 && rule.line != line)
+        {
+            return false;
+        }
+        const std::string_view path(file);
+        return path.size() >= rule.file.size() &&
+               path.compare(path.size() - rule.file.size(), rule.file.size(), rule.file) == 0;
+    }
+}
+
+std::uint8_t CallSiteSwitch::Register()
+{
+    auto& registry = Registry();
+    std::lock_guard<std::mutex> lock(registry.mtx);
+    std::uint8_t state = m_state.load(std::memory_order_relaxed);
+    if (state != kUnregistered)
+    {
+        return state; // another thread got here first
+    }
+    state = kFiltered;
+    for (const auto& rule : registry.rules)
+    {
+        if (RuleMatches(rule, m_file, m_line))
+        {
+            state = rule.enabled ? kForced : kFiltered;
+        }
+    }
+    m_next = registry.head;
+    registry.head = this;
+    m_state.store(state, std::memory_order_relaxed);
+    return state;
+}
+
+size_t EnableCallSites(const char* file, int line, bool enabled)
+{
+    auto& registry = Registry();
+    std::lock_guard<std::mutex> lock(registry.mtx);
+    CallSiteRule rule{file ? file : "", line, enabled};
+    size_t matched = 0;
+    for (CallSiteSwitch* site = registry.head; site; site = site->m_next)
+    {
+        if (RuleMatches(rule, site->m_file, site->m_line))
+        {
+            site->m_state.store(enabled ? CallSiteSwitch::kForced : CallSiteSwitch::kFiltered,
+                                std::memory_order_relaxed);
+            ++matched;
+        }
+    }
+    // The new rule supersedes an identical earlier one, so toggling does not grow the list
+    registry.rules.erase(std::remove_if(registry.rules.begin(), registry.rules.end(),
+                                        [&](const CallSiteRule& r) { return r.file == rule.file && r.line == line; }),
+                         registry.rules.end());
+    registry.rules.push_back(std::move(rule));
+    return matched;
+}
+
+bool LogLimiter::AdmitRate()
+{
+    const std::int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    std::int64_t due = m_dueNs.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        const std::int64_t start = std::max(due, now);
+        if (start - now > m_toleranceNs)
+        {
+            return false; // bucket empty
+        }
+        if (m_dueNs.compare_exchange_weak(due, start + m_intervalNs, std::memory_order_relaxed))
+        {
+            return true;
+        }
+    }
+}
+
 Logger::Logger(Sink& sink, Level initialLevel, size_t capacity)
-    : m_sink(&sink, [](Sink*) {}), m_capacity(capacity), m_level(initialLevel)
+    : Logger(sink, LoggerOptions{initialLevel, capacity, QueueMode::Locked, ClockSource::System, kDefaultArenaSize})
+{}
+
+Logger::Logger(Sink& sink, const LoggerOptions& options)
+    : m_primarySink(sink),
+      m_crashDrain(options.crashDrain),
+      m_capacity(ResolveCapacity(options)),
+      m_queueMode(options.queueMode),
+      m_backpressure(options.backpressure),
+      m_waitStrategy(options.waitStrategy),
+      m_clock(options.clock),
+      m_id(s_nextLoggerId.fetch_add(1, std::memory_order_relaxed)),
+      m_level(options.level),
+      m_backend(options.backend),
+      m_flushInterval(options.flushInterval),
+      m_flushThreshold(options.flushThreshold),
+      m_statsInterval(options.onStats ? options.statsInterval : std::chrono::milliseconds(0)),
+      m_onStats(options.onStats),
+      m_arena(options.arenaSize, !options.lazyStart)
 {
-    m_worker = std::thread([this]
+    if (options.crashDrain)
     {
-        Worker();
-    });
+        RegisterCrashLogger(this);
+    }
+    if (!options.lazyStart)
+    {
+        Start();
+    }
+}
+
+void Logger::Start()
+{
+    std::lock_guard<std::mutex> lock(m_startMtx);
+    if (m_started.load(std::memory_order_relaxed))
+    {
+        return; // another producer got here first
+    }
+    m_arena.Commit();
+    if (m_queueMode == QueueMode::LockFree)
+    {
+        m_ring = std::make_unique<MessageRing>(m_capacity);
+    }
+    else if (m_queueMode == QueueMode::Locked)
+    {
+        m_queue.emplace();
+    }
+    m_statShards = std::make_unique<StatShard[]>(kStatShards);
+    if (m_crashDrain && m_queueMode == QueueMode::PerThread)
+    {
+        m_crashRings = std::make_unique<std::atomic<ProducerRing*>[]>(kMaxCrashRings);
+    }
+    {
+        // Ahead of any sink added before the first record
+        std::lock_guard<std::mutex> sinksLock(m_sinksMtx);
+        m_sinks.insert(m_sinks.begin(), std::make_shared<SinkChannel>(*this, m_primarySink, Level::Trace, false));
+        m_sinksVersion.fetch_add(1, std::memory_order_release);
+    }
+    m_records.reserve(kMaxBatchSize);
+    m_batch.reserve(kMaxBatchSize);
+    m_renderOffsets.reserve(kMaxBatchSize);
+    m_lastFlush = std::chrono::steady_clock::now();
+    m_nextStats = m_lastFlush + m_statsInterval;
+    // After Shutdown() only the storage is needed, for producers that raced it;
+    // Enqueue drops their records
+    if (m_running.load(std::memory_order_relaxed))
+    {
+        m_workerLaunched = true;
+        if (m_backend)
+        {
+            m_backend->Add(*this);
+        }
+        else
+        {
+            m_worker = std::thread([this]
+            {
+                Worker();
+            });
+        }
+    }
+    // Publishes the storage to producers that skip the lock
+    m_started.store(true, std::memory_order_release);
 }
 
 Logger::~Logger()
 {
     Shutdown();
+    UnregisterCrashLogger(this);
 }
 
 void Logger::SetLevel(Level level)
@@ -104,158 +633,1943 @@ void Logger::SetLevel(Level level)
 
 void Logger::Log(Level level, const char* format, va_list args)
 {
-    if (level < m_level.load(std::memory_order_relaxed))
+    if (!IsEnabled(level))
     {
         return; // filtered out cheaply
     }
+    LogFormatted(level, format, args);
+}
+
+void Logger::LogUnfiltered(Level level, const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    LogFormatted(level, format, args);
+    va_end(args);
+}
+
+void Logger::LogFormatted(Level level, const char* format, va_list args)
+{
+    ThrowIfBreak(level);
 
+    // Format straight into arena space behind the record header; only text
+    // longer than the reservation pays for a second pass into an exact fit
+    size_t room;
+    Record* rec = AllocateRecord(level, false, kTextReserve, room);
+    StampRecord(*rec);
     va_list args_copy;
     va_copy(args_copy, args);
-    int needed = std::vsnprintf(nullptr, 0, format, args_copy);
+    const int len = std::vsnprintf(rec->Payload(), room, format, args_copy);
     va_end(args_copy);
-    if (needed < 0)
+    if (len < 0)
     {
+        ReleaseRecord(rec);
         return;
     }
-    std::string message(needed + 1, '\0');
-    int len = std::vsnprintf(message.data(), message.size(), format, args);
-    if (len < 0) return;
-    message.resize(len);
-
-    // Now call the std::string Log, but since we're removing it, inline the logic.
-
-    // Optional debug break if configured
-    if (m_breakEnabled.load(std::memory_order_relaxed) && level >= m_breakLevel.load(std::memory_order_relaxed))
+    const auto size = static_cast<size_t>(len);
+    if (size >= room)
     {
-        if (m_breakMode.load(std::memory_order_relaxed) == BreakMode::Throw)
-        {
-            throw BreakException{};
-        }
-        else
-        {
-            DebugBreakNow();
-        }
+        Record* large = AllocateRecord(level, false, size + 1, room);
+        large->tick = rec->tick;
+        large->flags |= rec->flags & Record::kTimestamp;
+        ReleaseRecord(rec);
+        rec = large;
+        std::vsnprintf(rec->Payload(), room, format, args);
     }
-    // Allocate storage for message text from pool (or heap fallback)
-    const auto size = message.size();
-    BufferPool::Allocation alloc;
+    else if (rec->flags & Record::kPooled)
     {
-        std::lock_guard<std::mutex> lk(m_poolMtx);
-        alloc = m_pool.Allocate(size);
+        m_arena.Shrink(rec, Record::HeaderSize(false) + size + 1);
     }
-    std::memcpy(alloc.ptr, message.data(), size);
+    rec->length = static_cast<std::uint32_t>(size);
 
-    Message msg;
-    msg.level = level;
-    if (m_timestampsEnabled.load(std::memory_order_relaxed))
+    Enqueue(rec);
+    TrapIfBreak(level);
+}
+
+void Logger::ThrowIfBreak(Level level)
+{
+    if (m_breakEnabled.load(std::memory_order_relaxed) && level >= m_breakLevel.load(std::memory_order_relaxed) &&
+        m_breakMode.load(std::memory_order_relaxed) == BreakMode::Throw)
     {
-        msg.timestamp = std::chrono::system_clock::now();
+        throw BreakException{};
     }
-    else
+}
+
+void Logger::TrapIfBreak(Level level)
+{
+    if (m_breakEnabled.load(std::memory_order_relaxed) && level >= m_breakLevel.load(std::memory_order_relaxed) &&
+        m_breakMode.load(std::memory_order_relaxed) == BreakMode::DebugBreak)
     {
-        msg.timestamp = std::nullopt;
+        // Get everything queued, the breaking record included, to the sinks
+        // before the trap can end the process
+        Flush();
+        DebugBreakNow();
     }
-    msg.text = std::string_view(static_cast<const char*>(alloc.ptr), size);
-    msg.storage = alloc.ptr;
-    msg.storageSize = alloc.size;
-    msg.storagePooled = alloc.pooled;
+}
 
+Logger::Record* Logger::AllocateRecord(Level level, bool deferred, size_t payloadSize, size_t& room)
+{
+    if (!m_started.load(std::memory_order_acquire))
     {
-        std::lock_guard<std::mutex> lock(m_mtx);
-        if (!m_running.load(std::memory_order_relaxed))
-        {
-            // release allocation and bail
-            ReleaseMessageStorage(msg);
-            return;
-        }
-        if (m_capacity != 0 && m_queue.size() >= m_capacity)
-        {
-            // drop oldest to keep tail recent without blocking
-            ReleaseMessageStorage(m_queue.front());
-            m_queue.pop_front();
-        }
-        m_queue.push_back(std::move(msg));
+        Start(); // first record to pass the filter of a lazily started Logger
     }
-    m_cv.notify_one();
+    // Allocate storage from the arena (or heap fallback); header and payload share it
+    const size_t headerSize = Record::HeaderSize(deferred);
+    const ByteArena::Allocation alloc = m_arena.Allocate(headerSize + payloadSize);
+    Record* rec = ::new (alloc.ptr) Record{};
+    rec->level = level;
+    rec->flags = static_cast<std::uint8_t>((deferred ? Record::kDeferred : 0) | (alloc.pooled ? Record::kPooled : 0));
+    room = alloc.size - headerSize;
+    return rec;
 }
 
-void Logger::Log(Level level, const char* format, ...)
+void Logger::StampRecord(Record& rec)
 {
-    va_list args;
-    va_start(args, format);
-    Log(level, format, args);
-    va_end(args);
+    // Only the raw reading is taken here; the worker turns it into a time_point
+    if (m_timestampsEnabled.load(std::memory_order_relaxed))
+    {
+        rec.tick = m_clock.Now();
+        rec.flags |= Record::kTimestamp;
+    }
 }
 
-void Logger::Flush()
+Logger::StatShard& Logger::LocalStatShard()
 {
-    m_flushRequested.store(true, std::memory_order_relaxed);
-    m_cv.notify_one();
+    return m_statShards[t_statSlot % kStatShards];
 }
 
-void Logger::Shutdown()
+bool Logger::ReleaseAllowed() const
 {
-    bool expected = true;
-    if (!m_running.compare_exchange_strong(expected, false))
+    if (!m_crashDrain)
     {
-        return; // already stopped
+        return true;
     }
-    m_cv.notify_one();
-    if (m_worker.joinable())
-        m_worker.join();
+    // Pairs with the fence in EmergencyDrain. A record is released only after
+    // it left the queue, so either the drain's walk starts past it or this
+    // sees the freeze and leaks it.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return !m_crashFrozen.load(std::memory_order_relaxed);
 }
 
-void Logger::Worker()
+void Logger::ReleaseRecord(Record* rec)
 {
-    std::unique_lock<std::mutex> lock(m_mtx);
-    while (m_running.load(std::memory_order_relaxed) || !m_queue.empty())
+    if (ReleaseAllowed())
     {
-        m_cv.wait(lock, [&]
-        {
-            return !m_running.load(std::memory_order_relaxed) || !m_queue.empty() || m_flushRequested.load(std::memory_order_relaxed);
-        });
+        FreeStorage(rec);
+    }
+}
 
-        while (!m_queue.empty())
-        {
-            Message msg = std::move(m_queue.front());
-            m_queue.pop_front();
-            // Unlock while writing to sink to avoid blocking producers
-            lock.unlock();
-            try
+void Logger::FreeStorage(Record* rec)
+{
+    m_arena.Deallocate(rec, (rec->flags & Record::kPooled) != 0);
+}
+
+void Logger::Enqueue(Record* rec)
+{
+    // Counted by where the record's final storage came from
+    StatShard& shard = LocalStatShard();
+    shard.allocated.fetch_add(1, std::memory_order_relaxed);
+    if (!(rec->flags & Record::kPooled))
+    {
+        m_heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (!m_running.load(std::memory_order_relaxed))
+    {
+        ReleaseRecord(rec);
+        return;
+    }
+    if (!TryPublish(rec))
+    {
+        switch (m_backpressure)
+        {
+            case Backpressure::DropOldest:
+                if (m_ring)
+                {
+                    while (!m_ring->TryPush(rec))
+                    {
+                        // drop oldest to keep tail recent without blocking
+                        Record* oldest;
+                        if (m_ring->TryPop(oldest))
+                        {
+                            m_droppedOldest.fetch_add(1, std::memory_order_relaxed);
+                            ReleaseRecord(oldest);
+                        }
+                    }
+                    break;
+                }
+                // A producer cannot pop its own PerThread ring: drop the newest
+                [[fallthrough]];
+            case Backpressure::DropNewest:
+                m_droppedNewest.fetch_add(1, std::memory_order_relaxed);
+                ReleaseRecord(rec);
+                return;
+            case Backpressure::SpinThenBlock:
+                if (SpinPublish(rec))
+                {
+                    break;
+                }
+                [[fallthrough]];
+            case Backpressure::Block:
+                if (!BlockingPublish(rec))
+                {
+                    ReleaseRecord(rec); // logger stopped while waiting
+                    return;
+                }
+                break;
+        }
+    }
+    shard.enqueued.fetch_add(1, std::memory_order_relaxed);
+    WakeWorker();
+}
+
+bool Logger::TryPublish(Record* rec)
+{
+    if (m_queueMode == QueueMode::PerThread)
+    {
+        return LocalProducerRing().TryPush(rec);
+    }
+    if (m_ring)
+    {
+        return m_ring->TryPush(rec);
+    }
+
+    // Storage of a rejected or evicted record is released after the lock is dropped
+    Record* discard = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        if (!m_running.load(std::memory_order_relaxed))
+        {
+            discard = rec; // stopped: the worker will not drain it
+        }
+        else if (m_capacity != 0 && m_queue->size() >= m_capacity)
+        {
+            if (m_backpressure != Backpressure::DropOldest)
             {
-                m_sink->Write(msg);
+                return false;
             }
-            catch (...)
+            QueueChange change(m_queueEpoch);
+            discard = m_queue->front();
+            m_queue->pop_front();
+            BumpGuarded(m_queuePopped);
+            m_droppedOldest.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (discard != rec)
+        {
+            QueueChange change(m_queueEpoch);
+            m_queue->push_back(rec);
+            BumpGuarded(m_queuePushed);
+        }
+    }
+    if (discard)
+    {
+        ReleaseRecord(discard);
+    }
+    return true;
+}
+
+void Logger::WakeWorker()
+{
+    if (m_backend)
+    {
+        m_backend->Wake();
+        return;
+    }
+    // Pairs with the fence in WaitForWork: either the worker sees our record
+    // before it parks, or we see it parked
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_workerSleeping.load(std::memory_order_relaxed) && m_workerSleeping.exchange(false))
+    {
+        {
+            // The worker set the flag under m_mtx and holds it until it waits
+            std::lock_guard<std::mutex> lock(m_mtx);
+        }
+        m_cv.notify_one();
+    }
+}
+
+bool Logger::SpinPublish(Record* rec)
+{
+    for (int i = 0; i < kBackpressureSpins; ++i)
+    {
+        CpuRelax();
+        if (TryPublish(rec))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Logger::BlockingPublish(Record* rec)
+{
+    m_blocked.fetch_add(1, std::memory_order_relaxed);
+    std::unique_lock<std::mutex> lock(m_spaceMtx);
+    m_waitingProducers.fetch_add(1, std::memory_order_relaxed);
+    // Pairs with the fence in NotifySpace: either the worker sees us waiting or
+    // our retry sees the room it made
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    bool published = false;
+    m_spaceCv.wait(lock, [&]
+    {
+        return !m_running.load(std::memory_order_relaxed) || (published = TryPublish(rec));
+    });
+    m_waitingProducers.fetch_sub(1, std::memory_order_relaxed);
+    return published;
+}
+
+void Logger::NotifySpace()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_waitingProducers.load(std::memory_order_relaxed) != 0)
+    {
+        std::lock_guard<std::mutex> lock(m_spaceMtx);
+        m_spaceCv.notify_all();
+    }
+}
+
+bool Logger::TryDequeue(Record*& rec)
+{
+    if (m_queueMode == QueueMode::PerThread)
+    {
+        if (m_producersVersion.load(std::memory_order_acquire) != m_workerProducersVersion)
+        {
+            RefreshProducers();
+        }
+        // Pick the oldest head across all producer rings; every record of a
+        // Logger uses the same clock, and untimestamped ones (tick 0) go first
+        ProducerRing* best = nullptr;
+        Record* bestRec = nullptr;
+        for (auto& ring : m_workerProducers)
+        {
+            Record* head = ring->Peek();
+            if (head && (!bestRec || head->tick < bestRec->tick))
             {
-                // Swallow sink exceptions to keep worker alive
+                best = ring.get();
+                bestRec = head;
             }
-            // Release any storage used by this message text
-            ReleaseMessageStorage(msg);
-            lock.lock();
         }
+        if (!best)
+        {
+            // Idle: a good moment to forget rings of exited threads
+            for (auto& ring : m_workerProducers)
+            {
+                if (ring->producerExited.load(std::memory_order_relaxed))
+                {
+                    RefreshProducers();
+                    break;
+                }
+            }
+            return false;
+        }
+        rec = bestRec;
+        best->Pop();
+        return true;
+    }
+    if (m_ring)
+    {
+        return m_ring->TryPop(rec);
+    }
+    std::lock_guard<std::mutex> lock(m_mtx);
+    if (m_queue->empty())
+    {
+        return false;
+    }
+    QueueChange change(m_queueEpoch);
+    rec = m_queue->front();
+    m_queue->pop_front();
+    BumpGuarded(m_queuePopped);
+    return true;
+}
 
-        if (m_flushRequested.exchange(false))
+size_t Logger::DequeueBatch(std::vector<Record*>& batch, size_t maxCount)
+{
+    if (m_queueMode == QueueMode::Locked)
+    {
+        // One lock round-trip for the whole batch
+        std::lock_guard<std::mutex> lock(m_mtx);
+        NoteQueueDepth(m_queue->size());
+        QueueChange change(m_queueEpoch);
+        while (batch.size() < maxCount && !m_queue->empty())
         {
-            lock.unlock();
-            try
+            batch.push_back(m_queue->front());
+            m_queue->pop_front();
+            BumpGuarded(m_queuePopped);
+        }
+        return batch.size();
+    }
+    Record* rec;
+    while (batch.size() < maxCount && TryDequeue(rec))
+    {
+        batch.push_back(rec);
+    }
+    if (!batch.empty())
+    {
+        // What was taken plus what is still waiting
+        size_t waiting = 0;
+        if (m_ring)
+        {
+            waiting = m_ring->PushedCount() - m_ring->PoppedCount();
+        }
+        else
+        {
+            for (const auto& ring : m_workerProducers)
             {
-                m_sink->Flush();
+                waiting += ring->PushedCount() - ring->PoppedCount();
             }
-            catch (...)
+        }
+        NoteQueueDepth(batch.size() + waiting);
+    }
+    return batch.size();
+}
+
+void Logger::NoteQueueDepth(size_t depth)
+{
+    if (depth > m_peakDepth.load(std::memory_order_relaxed))
+    {
+        m_peakDepth.store(depth, std::memory_order_relaxed);
+    }
+}
+
+void Logger::SampleLatency()
+{
+    // One clock read per batch; every kLatencySampleStride-th record is measured against it
+    if (m_sampleCountdown >= m_records.size())
+    {
+        m_sampleCountdown -= m_records.size();
+        return;
+    }
+    const std::uint64_t now = m_clock.Now();
+    for (size_t i = m_sampleCountdown; i < m_records.size(); i += kLatencySampleStride)
+    {
+        const Record* rec = m_records[i];
+        if (!(rec->flags & Record::kTimestamp))
+        {
+            continue;
+        }
+        std::uint64_t ns = m_clock.ElapsedNs(rec->tick, now);
+        size_t bucket = 0;
+        while (ns != 0 && bucket + 1 < LatencyHistogram::kBuckets)
+        {
+            ns >>= 1;
+            ++bucket;
+        }
+        m_latency[bucket].store(m_latency[bucket].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        m_latencySamples.store(m_latencySamples.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    const size_t past = (m_records.size() - m_sampleCountdown) % kLatencySampleStride;
+    m_sampleCountdown = past == 0 ? 0 : kLatencySampleStride - past;
+}
+
+LoggerStats Logger::GetStats() const
+{
+    LoggerStats stats;
+    std::uint64_t allocated = 0;
+    if (m_started.load(std::memory_order_acquire))
+    {
+        for (size_t i = 0; i < kStatShards; ++i)
+        {
+            allocated += m_statShards[i].allocated.load(std::memory_order_relaxed);
+            stats.enqueued += m_statShards[i].enqueued.load(std::memory_order_relaxed);
+        }
+    }
+    stats.backpressure = GetBackpressureStats();
+    stats.dropped = stats.backpressure.droppedNewest + stats.backpressure.droppedOldest;
+    stats.written = m_written.load(std::memory_order_relaxed);
+    stats.peakQueueDepth = m_peakDepth.load(std::memory_order_relaxed);
+    stats.heapAllocations = m_heapAllocations.load(std::memory_order_relaxed);
+    stats.arenaAllocations = allocated - std::min(allocated, stats.heapAllocations);
+    for (size_t i = 0; i < LatencyHistogram::kBuckets; ++i)
+    {
+        stats.latency.buckets[i] = m_latency[i].load(std::memory_order_relaxed);
+    }
+    stats.latency.samples = m_latencySamples.load(std::memory_order_relaxed);
+    return stats;
+}
+
+std::uint64_t LatencyHistogram::Percentile(double q) const
+{
+    if (samples == 0)
+    {
+        return 0;
+    }
+    const auto rank = static_cast<std::uint64_t>(std::clamp(q, 0.0, 1.0) * static_cast<double>(samples - 1)) + 1;
+    std::uint64_t seen = 0;
+    for (size_t i = 0; i < kBuckets; ++i)
+    {
+        seen += buckets[i];
+        if (seen >= rank)
+        {
+            return std::uint64_t{1} << i;
+        }
+    }
+    return std::uint64_t{1} << (kBuckets - 1);
+}
+
+void Logger::ExpandBatch()
+{
+    m_batch.clear();
+    m_batchDeferred = false;
+    for (Record* rec : m_records)
+    {
+        Message& msg = m_batch.emplace_back();
+        msg.level = rec->level;
+        if (rec->flags & Record::kTimestamp)
+        {
+            msg.timestamp = m_clock.ToSystem(rec->tick);
+        }
+        if (rec->flags & Record::kDeferred)
+        {
+            msg.format = rec->Deferred().format;
+            msg.signature = rec->Deferred().signature;
+            msg.render = msg.signature->render;
+            msg.args = rec->Payload();
+            m_batchDeferred = true;
+        }
+        else
+        {
+            msg.text = std::string_view(rec->Payload(), rec->length);
+        }
+    }
+}
+
+Logger::TickClock::TickClock(ClockSource source)
+    : m_source(source),
+      m_counter(source == ClockSource::Tsc && kHasCounter)
+{
+    if (m_source == ClockSource::System)
+    {
+        return;
+    }
+    if (!m_counter)
+    {
+        m_nsPerTick = 1.0; // steady_clock ticks are already nanoseconds
+    }
+#if defined(__aarch64__)
+    else
+    {
+        // The generic timer publishes its frequency; no measurement needed
+        std::uint64_t freq;
+        __asm__ __volatile__("mrs %0, cntfrq_el0" : "=r"(freq));
+        m_nsPerTick = 1e9 / static_cast<double>(freq);
+        m_counter = false;
+    }
+#else
+    else
+    {
+        // Initial rate estimate over a short spin; refined on every recalibration
+        const std::uint64_t t0 = CounterTicks();
+        const std::uint64_t n0 = SteadyTicks();
+        const auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(2);
+        while (std::chrono::steady_clock::now() < until)
+        {
+        }
+        const std::uint64_t t1 = CounterTicks();
+        const std::uint64_t n1 = SteadyTicks();
+        m_nsPerTick = t1 > t0 && n1 > n0 ? static_cast<double>(n1 - n0) / static_cast<double>(t1 - t0) : 1.0;
+        m_firstTick = t0;
+        m_firstSteadyNs = n0;
+    }
+#endif
+    Recalibrate();
+}
+
+std::uint64_t Logger::TickClock::Now() const
+{
+    switch (m_source)
+    {
+        case ClockSource::Tsc: return CounterTicks();
+        case ClockSource::Steady: return SteadyTicks();
+        default: return static_cast<std::uint64_t>(SystemNowNs());
+    }
+}
+
+std::chrono::system_clock::time_point Logger::TickClock::ToSystem(std::uint64_t tick) const
+{
+    if (m_source == ClockSource::System)
+    {
+        return std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(
+            std::chrono::nanoseconds(static_cast<std::int64_t>(tick))));
+    }
+    const double deltaTicks = tick >= m_baseTick ? static_cast<double>(tick - m_baseTick)
+                                                 : -static_cast<double>(m_baseTick - tick);
+    const auto ns = m_baseNs + static_cast<std::int64_t>(deltaTicks * m_nsPerTick);
+    return std::chrono::system_clock::time_point(
+        std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds(ns)));
+}
+
+std::uint64_t Logger::TickClock::ElapsedNs(std::uint64_t from, std::uint64_t to) const
+{
+    // system_clock may step backwards; such samples count as zero
+    if (to <= from)
+    {
+        return 0;
+    }
+    return static_cast<std::uint64_t>(static_cast<double>(to - from) * m_nsPerTick);
+}
+
+void Logger::TickClock::MaybeRecalibrate()
+{
+    if (m_source != ClockSource::System && std::chrono::steady_clock::now() >= m_nextCalibration)
+    {
+        Recalibrate();
+    }
+}
+
+void Logger::TickClock::Recalibrate()
+{
+    const std::uint64_t tick = Now();
+    const std::int64_t ns = SystemNowNs();
+    if (m_counter)
+    {
+        // Long-baseline rate estimate gets more precise as the logger runs.
+        // Measured against steady_clock: a wall clock step must not skew it.
+        const std::uint64_t steadyNs = SteadyTicks();
+        if (tick > m_firstTick && steadyNs > m_firstSteadyNs)
+        {
+            m_nsPerTick = static_cast<double>(steadyNs - m_firstSteadyNs) / static_cast<double>(tick - m_firstTick);
+        }
+    }
+    // Wall time only anchors the conversion
+    m_baseTick = tick;
+    m_baseNs = ns;
+    m_nextCalibration = std::chrono::steady_clock::now() + kClockCalibrationInterval;
+}
+
+void Logger::WriteSinks()
+{
+    bool wantText = false;
+    bool wantDeferred = false;
+    for (const auto& channel : m_workerSinks)
+    {
+        if (!channel->Detached())
+        {
+            (channel->GetSink().AcceptsDeferred() ? wantDeferred : wantText) = true;
+        }
+    }
+
+    // Sinks on their own thread take copies of the unrendered Messages
+    if (m_hasDetachedSinks)
+    {
+        for (const auto& channel : m_workerSinks)
+        {
+            if (channel->Detached())
             {
+                channel->Post(m_batch, m_records);
+            }
+        }
+    }
+
+    // Deferred records are rendered once for every inline sink that wants text
+    std::vector<Message>* textBatch = &m_batch;
+    if (wantText && m_batchDeferred)
+    {
+        if (wantDeferred)
+        {
+            m_textBatch = m_batch; // keep m_batch unrendered for the others
+            textBatch = &m_textBatch;
+        }
+        RenderMessages(*textBatch, m_renderBuffer, m_renderOffsets);
+    }
+    for (const auto& channel : m_workerSinks)
+    {
+        if (!channel->Detached())
+        {
+            channel->Write(channel->GetSink().AcceptsDeferred() ? m_batch : *textBatch, m_filtered);
+        }
+    }
+}
+
+void Logger::RefreshSinks()
+{
+    std::lock_guard<std::mutex> lock(m_sinksMtx);
+    m_workerSinks = m_sinks;
+    m_workerSinksVersion = m_sinksVersion.load(std::memory_order_relaxed);
+    m_hasDetachedSinks = false;
+    for (const auto& channel : m_workerSinks)
+    {
+        m_hasDetachedSinks = m_hasDetachedSinks || channel->Detached();
+    }
+}
+
+void Logger::AddSink(Sink& sink, Level minLevel, bool ownThread)
+{
+    auto channel = std::make_shared<SinkChannel>(*this, sink, minLevel, ownThread);
+    std::lock_guard<std::mutex> lock(m_sinksMtx);
+    m_sinks.push_back(std::move(channel));
+    m_sinksVersion.fetch_add(1, std::memory_order_release);
+}
+
+Logger::SinkChannel::SinkChannel(Logger& owner, Sink& sink, Level minLevel, bool ownThread)
+    : m_owner(owner),
+      m_sink(sink),
+      m_minLevel(minLevel),
+      m_detached(ownThread)
+{
+    if (m_detached)
+    {
+        m_thread = std::thread([this]
+        {
+            Drain();
+        });
+    }
+}
+
+Logger::SinkChannel::~SinkChannel()
+{
+    Stop();
+}
+
+void Logger::SinkChannel::Write(const std::vector<Message>& batch, std::vector<Message>& scratch)
+{
+    const Message* messages = batch.data();
+    size_t count = batch.size();
+    if (m_minLevel > Level::Trace)
+    {
+        scratch.clear();
+        for (const auto& msg : batch)
+        {
+            if (Accepts(msg.level))
+            {
+                scratch.push_back(msg);
             }
-            lock.lock();
         }
+        messages = scratch.data();
+        count = scratch.size();
+    }
+    if (count == 0)
+    {
+        return;
     }
-    // Final flush on exit
-    lock.unlock();
     try
     {
-        m_sink->Flush();
+        m_sink.WriteBatch(messages, count);
     }
     catch (...)
     {
+        // Swallow sink exceptions to keep worker alive
+    }
+}
+
+void Logger::SinkChannel::Post(const std::vector<Message>& batch, const std::vector<Record*>& records)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        for (size_t i = 0; i < batch.size(); ++i)
+        {
+            const Message& msg = batch[i];
+            if (!Accepts(msg.level))
+            {
+                continue;
+            }
+            if (m_pending.size() >= kMaxSinkBacklog ||
+                (!m_pending.empty() && m_bytes.size() - m_pending.front().offset >= kMaxSinkBacklogBytes))
+            {
+                // This sink alone is too slow: shed its oldest records
+                m_pending.pop_front();
+                m_owner.m_droppedOldest.fetch_add(1, std::memory_order_relaxed);
+                CompactBytes();
+            }
+            // The record's payload: text, or the encoded arguments of a deferred one
+            const char* payload = msg.IsDeferred() ? static_cast<const char*>(msg.args) : msg.text.data();
+            m_pending.push_back(Pending{msg, m_bytes.size()});
+            m_bytes.insert(m_bytes.end(), payload, payload + records[i]->length);
+        }
+    }
+    m_cv.notify_all();
+}
+
+void Logger::SinkChannel::CompactBytes()
+{
+    // Drop the bytes of shed records once they are most of the buffer
+    const size_t dead = m_pending.empty() ? m_bytes.size() : m_pending.front().offset;
+    if (dead < m_bytes.size() / 2)
+    {
+        return;
+    }
+    m_bytes.erase(m_bytes.begin(), m_bytes.begin() + static_cast<std::ptrdiff_t>(dead));
+    for (auto& item : m_pending)
+    {
+        item.offset -= dead;
+    }
+}
+
+std::uint64_t Logger::SinkChannel::RequestFlush()
+{
+    std::uint64_t ticket;
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        ticket = ++m_flushRequested;
+    }
+    m_cv.notify_all();
+    return ticket;
+}
+
+void Logger::SinkChannel::WaitFlushed(std::uint64_t ticket)
+{
+    std::unique_lock<std::mutex> lock(m_mtx);
+    m_cv.wait(lock, [&]
+    {
+        return m_flushDone >= ticket;
+    });
+}
+
+void Logger::SinkChannel::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+}
+
+void Logger::SinkChannel::Drain()
+{
+    std::vector<Message> batch;
+    std::vector<char> bytes;
+    std::string renderBuffer;
+    std::vector<size_t> renderOffsets;
+
+    std::unique_lock<std::mutex> lock(m_mtx);
+    for (;;)
+    {
+        m_cv.wait(lock, [&]
+        {
+            return m_stop || !m_pending.empty() || m_flushRequested != m_flushDone;
+        });
+        // Everything posted before a flush request is in this grab
+        const std::uint64_t flushTicket = m_flushRequested;
+        const bool flush = m_stop || flushTicket != m_flushDone;
+        const bool stop = m_stop;
+        bytes.swap(m_bytes);
+        m_bytes.clear(); // the previous grab's, already written
+        for (auto& item : m_pending)
+        {
+            Message& msg = batch.emplace_back(item.message);
+            if (msg.IsDeferred())
+            {
+                msg.args = bytes.data() + item.offset;
+            }
+            else
+            {
+                msg.text = std::string_view(bytes.data() + item.offset, msg.text.size());
+            }
+        }
+        m_pending.clear();
+        lock.unlock();
+
+        if (!batch.empty())
+        {
+            try
+            {
+                if (!m_sink.AcceptsDeferred())
+                {
+                    RenderMessages(batch, renderBuffer, renderOffsets);
+                }
+                m_sink.WriteBatch(batch.data(), batch.size());
+            }
+            catch (...)
+            {
+            }
+            batch.clear();
+        }
+        if (flush)
+        {
+            try
+            {
+                m_sink.Flush();
+            }
+            catch (...)
+            {
+            }
+        }
+
+        lock.lock();
+        if (flush)
+        {
+            m_flushDone = flushTicket;
+            m_cv.notify_all();
+        }
+        if (stop && m_pending.empty())
+        {
+            break;
+        }
+    }
+}
+
+Logger::ByteArena::ByteArena(size_t capacity, bool commit)
+    : m_capacity(capacity / kAlign * kAlign)
+{
+    if (commit)
+    {
+        Commit();
+    }
+}
+
+void Logger::ByteArena::Commit()
+{
+    if (m_capacity != 0 && !m_data)
+    {
+        m_data.reset(new char[m_capacity]());
+    }
+}
+
+Logger::ByteArena::Allocation Logger::ByteArena::Allocate(size_t n)
+{
+    const size_t total = (sizeof(Chunk) + n + kAlign - 1) / kAlign * kAlign;
+    Chunk* chunk = nullptr;
+    if (total <= m_capacity && total <= UINT32_MAX && (TryReserve(total, chunk) || (Reclaim(), TryReserve(total, chunk))))
+    {
+        return Allocation{ chunk + 1, total - sizeof(Chunk), true };
+    }
+    // Fallback to heap for oversized records or a full arena
+    char* p = new char[n];
+    return Allocation{ p, n, false };
+}
+
+bool Logger::ByteArena::TryReserve(size_t total, Chunk*& chunk)
+{
+    std::uint64_t head = m_head.load(std::memory_order_relaxed);
+    size_t pad;
+    for (;;)
+    {
+        // Acquiring the tail orders our writes after Reclaim zeroed the space
+        const std::uint64_t tail = m_tail.load(std::memory_order_acquire);
+        const size_t offset = static_cast<size_t>(head % m_capacity);
+        pad = offset + total > m_capacity ? m_capacity - offset : 0; // chunks never wrap
+        if (head + pad + total - tail > m_capacity)
+        {
+            return false;
+        }
+        if (m_head.compare_exchange_weak(head, head + pad + total, std::memory_order_relaxed))
+        {
+            break;
+        }
+    }
+    if (pad != 0)
+    {
+        // Skip the end of the buffer with a chunk that is free from the start
+        Chunk* filler = ChunkAt(head);
+        filler->size = static_cast<std::uint32_t>(pad);
+        filler->state.store(kFree, std::memory_order_release);
+    }
+    chunk = ChunkAt(head + pad);
+    chunk->size = static_cast<std::uint32_t>(total);
+    chunk->state.store(kInUse, std::memory_order_release);
+    return true;
+}
+
+void Logger::ByteArena::Shrink(void* p, size_t n)
+{
+    Chunk* chunk = static_cast<Chunk*>(p) - 1;
+    const size_t total = (sizeof(Chunk) + n + kAlign - 1) / kAlign * kAlign;
+    if (total >= chunk->size)
+    {
+        return;
+    }
+    // Still the newest chunk: just pull the head back
+    const auto start = static_cast<std::uint64_t>(reinterpret_cast<char*>(chunk) - m_data.get());
+    std::uint64_t expected = m_head.load(std::memory_order_relaxed);
+    if (expected % m_capacity == (start + chunk->size) % m_capacity &&
+        m_head.compare_exchange_strong(expected, expected - (chunk->size - total), std::memory_order_relaxed))
+    {
+        chunk->size = static_cast<std::uint32_t>(total);
+        return;
+    }
+    // Otherwise the remainder becomes a free chunk the tail will sweep over
+    Chunk* rest = reinterpret_cast<Chunk*>(reinterpret_cast<char*>(chunk) + total);
+    rest->size = chunk->size - static_cast<std::uint32_t>(total);
+    chunk->size = static_cast<std::uint32_t>(total);
+    rest->state.store(kFree, std::memory_order_release);
+}
+
+void Logger::ByteArena::Deallocate(void* p, bool pooled)
+{
+    if (!p) return;
+    if (!pooled)
+    {
+        delete[] static_cast<char*>(p);
+        return;
+    }
+    Chunk* chunk = static_cast<Chunk*>(p) - 1;
+    chunk->state.store(kFree, std::memory_order_release);
+    m_releases.fetch_add(1, std::memory_order_acq_rel);
+    Reclaim();
+}
+
+void Logger::ByteArena::Reclaim()
+{
+    for (;;)
+    {
+        const std::uint64_t releases = m_releases.load(std::memory_order_acquire);
+        if (m_reclaiming.exchange(true, std::memory_order_acquire))
+        {
+            return; // the thread holding it will see our release count
+        }
+        std::uint64_t tail = m_tail.load(std::memory_order_relaxed);
+        const std::uint64_t head = m_head.load(std::memory_order_acquire);
+        while (tail < head)
+        {
+            Chunk* chunk = ChunkAt(tail);
+            if (chunk->state.load(std::memory_order_acquire) != kFree)
+            {
+                break;
+            }
+            // Re-zero so a later reservation's header is never confused with old bytes
+            const size_t size = chunk->size;
+            std::memset(static_cast<void*>(chunk), 0, size);
+            tail += size;
+        }
+        m_tail.store(tail, std::memory_order_release);
+        m_reclaiming.store(false, std::memory_order_release);
+        if (m_releases.load(std::memory_order_acquire) == releases)
+        {
+            return;
+        }
+    }
+}
+
+bool Logger::QueueEmpty()
+{
+    if (m_queueMode == QueueMode::PerThread)
+    {
+        return ProducersEmpty();
+    }
+    if (m_ring)
+    {
+        return m_ring->Empty();
+    }
+    std::lock_guard<std::mutex> lock(m_mtx);
+    return m_queue->empty();
+}
+
+bool Logger::ProducersEmpty()
+{
+    std::lock_guard<std::mutex> lock(m_producersMtx);
+    for (const auto& ring : m_producers)
+    {
+        if (!ring->Empty())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Logger::RefreshProducers()
+{
+    std::lock_guard<std::mutex> lock(m_producersMtx);
+    // Forget rings whose thread has exited once they have been drained
+    for (size_t i = 0; i < m_producers.size();)
+    {
+        if (m_producers[i]->producerExited.load(std::memory_order_acquire) && m_producers[i]->Empty())
+        {
+            m_producers[i] = std::move(m_producers.back());
+            m_producers.pop_back();
+        }
+        else
+        {
+            ++i;
+        }
+    }
+    PublishCrashRings();
+    m_workerProducers = m_producers;
+    m_workerProducersVersion = m_producersVersion.load(std::memory_order_relaxed);
+}
+
+void Logger::PublishCrashRings()
+{
+    if (!m_crashRings)
+    {
+        return;
+    }
+    // Hidden while the slots change, so EmergencyDrain sees a consistent prefix
+    m_crashRingCount.store(0, std::memory_order_release);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const size_t count = std::min(m_producers.size(), kMaxCrashRings);
+    for (size_t i = 0; i < count; ++i)
+    {
+        m_crashRings[i].store(m_producers[i].get(), std::memory_order_relaxed);
+    }
+    m_crashRingCount.store(count, std::memory_order_release);
+}
+
+Logger::ProducerRing& Logger::LocalProducerRing()
+{
+    struct Binding
+    {
+        std::uint64_t loggerId;
+        std::shared_ptr<ProducerRing> ring;
+    };
+    struct ThreadBindings
+    {
+        std::vector<Binding> bindings;
+        ~ThreadBindings()
+        {
+            for (auto& b : bindings)
+            {
+                b.ring->producerExited.store(true, std::memory_order_release);
+            }
+        }
+    };
+    thread_local ThreadBindings t_local;
+
+    auto& bindings = t_local.bindings;
+    for (auto& b : bindings)
+    {
+        if (b.loggerId == m_id)
+        {
+            return *b.ring;
+        }
+    }
+
+    // First message from this thread: drop bindings to stopped loggers, then register
+    for (size_t i = 0; i < bindings.size();)
+    {
+        if (bindings[i].ring->loggerStopped.load(std::memory_order_relaxed))
+        {
+            bindings[i] = std::move(bindings.back());
+            bindings.pop_back();
+        }
+        else
+        {
+            ++i;
+        }
+    }
+    auto ring = std::make_shared<ProducerRing>(m_capacity);
+    {
+        std::lock_guard<std::mutex> lock(m_producersMtx);
+        m_producers.push_back(ring);
+        PublishCrashRings();
+        // Bump while holding the lock so a concurrent refresh cannot miss this ring
+        m_producersVersion.fetch_add(1, std::memory_order_release);
+    }
+    bindings.push_back(Binding{m_id, ring});
+    return *ring;
+}
+
+void Logger::Log(Level level, const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    Log(level, format, args);
+    va_end(args);
+}
+
+void Logger::Flush()
+{
+    if (!m_started.load(std::memory_order_acquire))
+    {
+        return; // lazily started and nothing logged yet
+    }
+    std::unique_lock<std::mutex> lock(m_flushMtx);
+    const std::uint64_t ticket = m_flushRequests.fetch_add(1, std::memory_order_acq_rel) + 1;
+    NotifyWorker();
+    if (t_workerOf == this)
+    {
+        return; // a sink logging from the worker: waiting would deadlock
+    }
+    m_flushCv.wait(lock, [&]
+    {
+        return m_workerDone || m_flushCompleted >= ticket;
+    });
+}
+
+void Logger::Shutdown()
+{
+    bool expected = true;
+    if (!m_running.compare_exchange_strong(expected, false))
+    {
+        return; // already stopped
+    }
+    {
+        // Either Start() has launched the worker, or it never will. A Start()
+        // that ran after m_running was cleared only set up storage.
+        std::lock_guard<std::mutex> lock(m_startMtx);
+        if (!m_workerLaunched)
+        {
+            std::lock_guard<std::mutex> flushLock(m_flushMtx);
+            m_workerDone = true;
+            return;
+        }
+    }
+    NotifyWorker();
+    {
+        // Release producers parked by Backpressure::Block
+        std::lock_guard<std::mutex> lock(m_spaceMtx);
+        m_spaceCv.notify_all();
+    }
+    if (m_worker.joinable())
+        m_worker.join();
+    if (m_backend)
+    {
+        // Take the Logger back from the shared threads and finish it here
+        m_backend->Remove(*this);
+        const Logger* outer = std::exchange(t_workerOf, this);
+        while (Pump(std::numeric_limits<size_t>::max()))
+        {
+        }
+        FinishWorker();
+        t_workerOf = outer;
+    }
+
+    // Producers racing with shutdown may still have published into a ring
+    Record* rec;
+    while (TryDequeue(rec))
+    {
+        ReleaseRecord(rec);
+    }
+    std::lock_guard<std::mutex> lock(m_producersMtx);
+    for (auto& ring : m_producers)
+    {
+        ring->loggerStopped.store(true, std::memory_order_relaxed);
+    }
+}
+
+void Logger::CaptureFlushTargets()
+{
+    // Taken after the request was observed, so it covers everything logged before Flush()
+    m_flushPending = true;
+    switch (m_queueMode)
+    {
+        case QueueMode::LockFree:
+            m_flushTarget = m_ring->PushedCount();
+            break;
+        case QueueMode::PerThread:
+            RefreshProducers();
+            m_flushTargets.clear();
+            for (auto& ring : m_workerProducers)
+            {
+                m_flushTargets.emplace_back(ring, ring->PushedCount());
+            }
+            break;
+        default:
+            m_flushTarget = m_queuePushed.load(std::memory_order_acquire);
+            break;
+    }
+}
+
+bool Logger::FlushTargetsReached()
+{
+    switch (m_queueMode)
+    {
+        case QueueMode::LockFree:
+            return m_ring->PoppedCount() >= m_flushTarget;
+        case QueueMode::PerThread:
+            for (const auto& target : m_flushTargets)
+            {
+                if (target.first->PoppedCount() < target.second)
+                {
+                    return false;
+                }
+            }
+            return true;
+        default:
+            return m_queuePopped.load(std::memory_order_acquire) >= m_flushTarget;
+    }
+}
+
+bool Logger::AutoFlushDue(std::chrono::steady_clock::time_point now) const
+{
+    if (m_unflushed == 0)
+    {
+        return false;
+    }
+    return (m_flushThreshold != 0 && m_unflushed >= m_flushThreshold) ||
+           (m_flushInterval.count() > 0 && now - m_lastFlush >= m_flushInterval);
+}
+
+void Logger::FlushSinks(std::chrono::steady_clock::time_point now, bool wait)
+{
+    // Sinks with their own thread flush after draining what they were handed
+    m_flushTickets.clear();
+    for (const auto& channel : m_workerSinks)
+    {
+        if (channel->Detached())
+        {
+            m_flushTickets.push_back(channel->RequestFlush());
+            continue;
+        }
+        try
+        {
+            channel->GetSink().Flush();
+        }
+        catch (...)
+        {
+        }
+    }
+    if (wait)
+    {
+        size_t i = 0;
+        for (const auto& channel : m_workerSinks)
+        {
+            if (channel->Detached())
+            {
+                channel->WaitFlushed(m_flushTickets[i++]);
+            }
+        }
+    }
+    m_unflushed = 0;
+    m_lastFlush = now;
+}
+
+void Logger::CompleteFlushes(std::uint64_t upTo)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_flushMtx);
+        m_flushCompleted = upTo;
+    }
+    m_flushCv.notify_all();
+}
+
+bool Logger::StatsDue(std::chrono::steady_clock::time_point now) const
+{
+    return m_statsInterval.count() > 0 && now >= m_nextStats;
+}
+
+void Logger::ReportStats(std::chrono::steady_clock::time_point now)
+{
+    m_nextStats = now + m_statsInterval;
+    try
+    {
+        m_onStats(GetStats());
+    }
+    catch (...)
+    {
+    }
+}
+
+std::chrono::steady_clock::time_point Logger::NextDeadline() const
+{
+    auto deadline = std::chrono::steady_clock::time_point::max();
+    // Written records must not wait past the auto-flush interval
+    if (m_unflushed != 0 && m_flushInterval.count() > 0)
+    {
+        deadline = m_lastFlush + m_flushInterval;
+    }
+    if (m_statsInterval.count() > 0)
+    {
+        deadline = std::min(deadline, m_nextStats);
+    }
+    return deadline;
+}
+
+void Logger::NotifyWorker()
+{
+    if (m_backend)
+    {
+        m_backend->Wake();
+        return;
+    }
+    {
+        // Serialize with the worker's predicate check so the wakeup cannot be missed
+        std::lock_guard<std::mutex> lock(m_mtx);
+    }
+    m_cv.notify_one();
+}
+
+bool Logger::HasWork()
+{
+    if (!m_running.load(std::memory_order_relaxed) ||
+        m_flushRequests.load(std::memory_order_relaxed) != m_flushObserved)
+    {
+        return true;
+    }
+    switch (m_queueMode)
+    {
+        case QueueMode::LockFree:
+            return !m_ring->Empty();
+        case QueueMode::PerThread:
+            if (m_producersVersion.load(std::memory_order_acquire) != m_workerProducersVersion)
+            {
+                return true; // a new producer registered
+            }
+            for (const auto& ring : m_workerProducers)
+            {
+                if (!ring->Empty())
+                {
+                    return true;
+                }
+            }
+            return false;
+        default:
+            // Never m_mtx here: the spin loops would fight producers for it
+            return m_queuePushed.load(std::memory_order_acquire) != m_queuePopped.load(std::memory_order_relaxed);
+    }
+}
+
+void Logger::WaitForWork()
+{
+    const auto deadline = NextDeadline();
+    if (m_waitStrategy != WaitStrategy::Park)
+    {
+        for (int i = 0; m_waitStrategy == WaitStrategy::BusySpin || i < kWorkerSpins; ++i)
+        {
+            if (HasWork())
+            {
+                return;
+            }
+            if ((i & 1023) == 1023 && std::chrono::steady_clock::now() >= deadline)
+            {
+                return;
+            }
+            CpuRelax();
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(m_mtx);
+    auto ready = [&]
+    {
+        if (!m_running.load(std::memory_order_relaxed) ||
+            m_flushRequests.load(std::memory_order_relaxed) != m_flushObserved)
+        {
+            return true;
+        }
+        switch (m_queueMode)
+        {
+            case QueueMode::LockFree: return !m_ring->Empty();
+            case QueueMode::PerThread: return !ProducersEmpty();
+            default: return !m_queue->empty();
+        }
+    };
+    // The flag is raised again before every wait: a producer that published
+    // before our last check may still clear it late, and its wakeup then finds
+    // nothing to do. Waiting on with the flag down would miss every later record.
+    for (;;)
+    {
+        m_workerSleeping.store(true, std::memory_order_relaxed);
+        // Pairs with the fence in WakeWorker
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (ready())
+        {
+            break;
+        }
+        if (deadline == std::chrono::steady_clock::time_point::max())
+        {
+            m_cv.wait(lock);
+        }
+        else if (m_cv.wait_until(lock, deadline) == std::cv_status::timeout)
+        {
+            break;
+        }
+    }
+    m_workerSleeping.store(false, std::memory_order_relaxed);
+}
+
+void Logger::Worker()
+{
+    t_workerOf = this;
+    do
+    {
+        WaitForWork();
+    } while (Pump(std::numeric_limits<size_t>::max()));
+    FinishWorker();
+}
+
+bool Logger::Pump(size_t maxBatches)
+{
+    const bool autoFlush = m_flushInterval.count() > 0 || m_flushThreshold != 0;
+    m_clock.MaybeRecalibrate();
+    if (m_sinksVersion.load(std::memory_order_acquire) != m_workerSinksVersion)
+    {
+        RefreshSinks();
+    }
+    const std::uint64_t flushRequest = m_flushRequests.load(std::memory_order_acquire);
+    if (flushRequest != m_flushObserved)
+    {
+        m_flushObserved = flushRequest;
+        CaptureFlushTargets();
+    }
+
+    // Queue lock is only held inside DequeueBatch, never while writing to the sink
+    for (size_t batches = 0; batches < maxBatches && DequeueBatch(m_records, kMaxBatchSize) > 0; ++batches)
+    {
+        if (m_backpressure == Backpressure::Block || m_backpressure == Backpressure::SpinThenBlock)
+        {
+            NotifySpace();
+        }
+        SampleLatency();
+        try
+        {
+            ExpandBatch();
+            WriteSinks();
+        }
+        catch (...)
+        {
+            // Swallow sink exceptions to keep worker alive
+        }
+        m_unflushed += m_records.size();
+        m_written.store(m_written.load(std::memory_order_relaxed) + m_records.size(), std::memory_order_relaxed);
+        // Release the storage used by the batch (sinks on their own thread made copies)
+        if (ReleaseAllowed())
+        {
+            for (Record* rec : m_records)
+            {
+                FreeStorage(rec);
+            }
+        }
+        m_records.clear();
+
+        if (m_flushPending && FlushTargetsReached())
+        {
+            break; // answer the waiting Flush() before draining newer records
+        }
+        if (autoFlush)
+        {
+            const auto now = std::chrono::steady_clock::now();
+            if (AutoFlushDue(now))
+            {
+                FlushSinks(now, false);
+            }
+        }
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    const bool flushDone = m_flushPending && FlushTargetsReached();
+    if (flushDone || (autoFlush && AutoFlushDue(now)))
+    {
+        FlushSinks(now, flushDone);
+    }
+    if (flushDone)
+    {
+        m_flushPending = false;
+        CompleteFlushes(m_flushObserved);
+    }
+    if (StatsDue(now))
+    {
+        ReportStats(now);
+    }
+
+    return m_running.load(std::memory_order_relaxed) || !QueueEmpty();
+}
+
+void Logger::FinishWorker()
+{
+    // Final flush on exit; it answers every outstanding and future Flush()
+    const auto now = std::chrono::steady_clock::now();
+    FlushSinks(now, false);
+    if (m_statsInterval.count() > 0)
+    {
+        ReportStats(now);
+    }
+    for (const auto& channel : m_workerSinks)
+    {
+        channel->Stop(); // drains and flushes sinks with their own thread
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_flushMtx);
+        m_workerDone = true;
+    }
+    m_flushCv.notify_all();
+}
+
+LogBackend::LogBackend(size_t threads)
+{
+    if (threads == 0)
+    {
+        throw std::invalid_argument("QLog: LogBackend needs at least one thread");
+    }
+    m_threads.reserve(threads);
+    for (size_t i = 0; i < threads; ++i)
+    {
+        m_threads.emplace_back([this]
+        {
+            Run();
+        });
+    }
+}
+
+LogBackend::~LogBackend()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    for (auto& thread : m_threads)
+    {
+        thread.join();
+    }
+}
+
+size_t LogBackend::LoggerCount() const
+{
+    std::lock_guard<std::mutex> lock(m_mtx);
+    return m_loggers.size();
+}
+
+void LogBackend::Add(Logger& logger)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_loggers.push_back(&logger);
+    }
+    Wake();
+}
+
+void LogBackend::Remove(Logger& logger)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_loggers.erase(std::find(m_loggers.begin(), m_loggers.end(), &logger));
+    }
+    // Claims are only taken under m_mtx, so once this one is ours no backend
+    // thread will touch the Logger again
+    while (logger.m_claimed.exchange(true, std::memory_order_acquire))
+    {
+        std::this_thread::yield();
+    }
+}
+
+void LogBackend::Wake()
+{
+    // Pairs with the fence in Run: either the parking thread sees the new
+    // work in its final scan, or we see it idle
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_idle.load(std::memory_order_relaxed) != 0)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+        }
+        m_cv.notify_one();
+    }
+}
+
+Logger* LogBackend::Claim()
+{
+    // Next Logger in round-robin order that no other thread is serving
+    for (size_t n = m_loggers.size(); n > 0; --n)
+    {
+        Logger* logger = m_loggers[m_next++ % m_loggers.size()];
+        if (!logger->m_claimed.exchange(true, std::memory_order_acquire))
+        {
+            return logger;
+        }
+    }
+    return nullptr;
+}
+
+void LogBackend::Run()
+{
+    std::unique_lock<std::mutex> lock(m_mtx);
+    while (!m_stop)
+    {
+        // One round-robin pass, serving each Logger that has something to do
+        bool worked = false;
+        for (size_t n = m_loggers.size(); n > 0 && !m_stop; --n)
+        {
+            Logger* logger = Claim();
+            if (!logger)
+            {
+                break;
+            }
+            lock.unlock();
+            t_workerOf = logger;
+            const auto now = std::chrono::steady_clock::now();
+            if (logger->HasWork() || logger->AutoFlushDue(now) || logger->StatsDue(now))
+            {
+                logger->Pump(kBackendBatches);
+                worked = true;
+            }
+            t_workerOf = nullptr;
+            logger->m_claimed.store(false, std::memory_order_release);
+            lock.lock();
+        }
+        if (worked || m_stop)
+        {
+            continue;
+        }
+
+        // Park, after a final look at every Logger no other thread is serving
+        // (a busy one is rescanned by its server before that thread parks)
+        m_idle.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool ready = false;
+        auto deadline = std::chrono::steady_clock::time_point::max();
+        for (Logger* logger : m_loggers)
+        {
+            if (logger->m_claimed.exchange(true, std::memory_order_acquire))
+            {
+                continue;
+            }
+            ready = ready || logger->HasWork();
+            deadline = std::min(deadline, logger->NextDeadline());
+            logger->m_claimed.store(false, std::memory_order_release);
+        }
+        if (!ready)
+        {
+            if (deadline == std::chrono::steady_clock::time_point::max())
+            {
+                m_cv.wait(lock);
+            }
+            else
+            {
+                m_cv.wait_until(lock, deadline);
+            }
+        }
+        m_idle.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+namespace
+{
+    constexpr size_t kMaxCrashLoggers = 64;
+    std::atomic<Logger*> s_crashLoggers[kMaxCrashLoggers];
+    std::atomic<int> s_crashFd{-1};
+    std::atomic<bool> s_crashDrained{false};
+
+    void RegisterCrashLogger(Logger* logger)
+    {
+        for (auto& slot : s_crashLoggers)
+        {
+            Logger* expected = nullptr;
+            if (slot.compare_exchange_strong(expected, logger))
+            {
+                return;
+            }
+        }
+        // Full: this Logger is simply not drained on a crash
+    }
+
+    void UnregisterCrashLogger(Logger* logger)
+    {
+        for (auto& slot : s_crashLoggers)
+        {
+            Logger* expected = logger;
+            if (slot.compare_exchange_strong(expected, nullptr))
+            {
+                return;
+            }
+        }
+    }
+
+    // write(2) until done; async-signal-safe
+    void EmergencyWrite(int fd, const char* data, size_t size)
+    {
+        while (size != 0)
+        {
+#if defined(_WIN32)
+            const int n = ::_write(fd, data, static_cast<unsigned>(std::min<size_t>(size, 1u << 30)));
+#else
+            const ssize_t n = ::write(fd, data, size);
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+#endif
+            if (n <= 0)
+            {
+                return;
+            }
+            data += n;
+            size -= static_cast<size_t>(n);
+        }
+    }
+
+    // "[YYYY-MM-DD HH:MM:SS.uuuuuuZ] "; UTC, since the local offset needs localtime
+    size_t FormatUtcTimestamp(std::chrono::system_clock::time_point tp, char* out)
+    {
+        const auto us = std::chrono::duration_cast<std::chrono::microseconds>(tp.time_since_epoch()).count();
+        const std::int64_t second = FloorDiv(us, 1000000);
+        const std::int64_t days = FloorDiv(second, 86400);
+        const auto secOfDay = static_cast<unsigned>(second - days * 86400);
+        int year;
+        unsigned month;
+        unsigned day;
+        CivilFromDays(days, year, month, day);
+        std::memcpy(out, "[0000-00-00 00:00:00.000000Z] ", 30);
+        PutDigits(out + 1, static_cast<unsigned>(year), 4);
+        PutDigits(out + 6, month, 2);
+        PutDigits(out + 9, day, 2);
+        PutDigits(out + 12, secOfDay / 3600, 2);
+        PutDigits(out + 15, secOfDay / 60 % 60, 2);
+        PutDigits(out + 18, secOfDay % 60, 2);
+        PutDigits(out + 21, static_cast<unsigned>(us - second * 1000000), 6);
+        return 30;
+    }
+
+    void DrainForCrash()
+    {
+        const int fd = s_crashFd.load(std::memory_order_acquire);
+        if (fd < 0 || s_crashDrained.exchange(true))
+        {
+            return; // not installed, or already done (terminate -> abort -> SIGABRT)
+        }
+        static const char kBanner[] = "QLog: records still queued at crash:\n";
+        EmergencyWrite(fd, kBanner, sizeof(kBanner) - 1);
+        for (auto& slot : s_crashLoggers)
+        {
+            if (Logger* logger = slot.load(std::memory_order_acquire))
+            {
+                logger->EmergencyDrain(fd);
+            }
+        }
+    }
+
+#if defined(_WIN32)
+    constexpr int kCrashSignals[] = {SIGSEGV, SIGILL, SIGFPE, SIGABRT};
+    using SignalHandler = void (*)(int);
+    SignalHandler s_previousHandlers[std::size(kCrashSignals)];
+#else
+    constexpr int kCrashSignals[] = {SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT};
+    struct sigaction s_previousActions[std::size(kCrashSignals)];
+#endif
+    std::terminate_handler s_previousTerminate = nullptr;
+    bool s_crashInstalled = false;
+    std::mutex s_crashInstallMtx;
+
+    void RestoreSignal(size_t i)
+    {
+#if defined(_WIN32)
+        std::signal(kCrashSignals[i], s_previousHandlers[i]);
+#else
+        ::sigaction(kCrashSignals[i], &s_previousActions[i], nullptr);
+#endif
+    }
+
+    extern "C" void OnCrashSignal(int sig)
+    {
+        DrainForCrash();
+        // Put the previous disposition back and let it run: the process still
+        // dies (or dumps core) the way it would have without us
+        for (size_t i = 0; i < std::size(kCrashSignals); ++i)
+        {
+            if (kCrashSignals[i] == sig)
+            {
+                RestoreSignal(i);
+            }
+        }
+        std::raise(sig);
+    }
+
+    void OnTerminate()
+    {
+        DrainForCrash();
+        if (s_previousTerminate)
+        {
+            s_previousTerminate();
+        }
+        std::abort();
+    }
+}
+
+size_t Logger::EmergencyDrain(int fd)
+{
+    if (!m_crashDrain || !m_started.load(std::memory_order_acquire))
+    {
+        return 0; // not opted in, or a lazily started Logger with no storage yet
+    }
+    // Nothing is freed from here on, so the records walked below stay valid
+    // even if the worker writes them meanwhile. Pairs with ReleaseAllowed.
+    m_crashFrozen.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    size_t written = 0;
+    char prefix[64];
+    auto emit = [&](Record* rec)
+    {
+        size_t length = 0;
+        if (rec->flags & Record::kTimestamp)
+        {
+            length = FormatUtcTimestamp(m_clock.ToSystem(rec->tick), prefix);
+        }
+        const char* level = ToString(rec->level);
+        const size_t levelLength = std::strlen(level);
+        std::memcpy(prefix + length, level, levelLength);
+        length += levelLength;
+        prefix[length++] = ':';
+        prefix[length++] = ' ';
+        EmergencyWrite(fd, prefix, length);
+        if (rec->flags & Record::kDeferred)
+        {
+            // Rendering would need snprintf, which is not async-signal-safe
+            const char* format = rec->Deferred().format;
+            EmergencyWrite(fd, format, std::strlen(format));
+            EmergencyWrite(fd, " [unrendered]\n", 14);
+        }
+        else
+        {
+            EmergencyWrite(fd, rec->Payload(), rec->length);
+            EmergencyWrite(fd, "\n", 1);
+        }
+        ++written;
+    };
+    switch (m_queueMode)
+    {
+        case QueueMode::LockFree:
+            m_ring->ForEachPending(emit);
+            break;
+        case QueueMode::PerThread:
+        {
+            // The lock-free snapshot of m_producers: the vector itself may be
+            // reallocating under m_producersMtx, which a handler cannot take
+            const size_t count = m_crashRings ? m_crashRingCount.load(std::memory_order_acquire) : 0;
+            for (size_t i = 0; i < count; ++i)
+            {
+                m_crashRings[i].load(std::memory_order_relaxed)->ForEachPending(emit);
+            }
+            break;
+        }
+        default:
+        {
+            // m_mtx cannot be used from a signal handler (the crashing thread
+            // may hold it); an odd epoch means a change is in progress
+            const size_t epoch = m_queueEpoch.load(std::memory_order_acquire);
+            if (epoch % 2 == 0)
+            {
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                for (Record* rec : *m_queue)
+                {
+                    emit(rec);
+                }
+            }
+            break;
+        }
+    }
+    return written;
+}
+
+void InstallCrashHandler(int fd)
+{
+    std::lock_guard<std::mutex> lock(s_crashInstallMtx);
+    s_crashFd.store(fd, std::memory_order_release);
+    s_crashDrained.store(false, std::memory_order_relaxed);
+    if (s_crashInstalled)
+    {
+        return;
+    }
+    for (size_t i = 0; i < std::size(kCrashSignals); ++i)
+    {
+#if defined(_WIN32)
+        s_previousHandlers[i] = std::signal(kCrashSignals[i], OnCrashSignal);
+#else
+        struct sigaction action{};
+        action.sa_handler = OnCrashSignal;
+        sigemptyset(&action.sa_mask);
+        action.sa_flags = SA_ONSTACK; // runs on an alternate stack where the thread has one
+        ::sigaction(kCrashSignals[i], &action, &s_previousActions[i]);
+#endif
+    }
+    s_previousTerminate = std::set_terminate(OnTerminate);
+    s_crashInstalled = true;
+}
+
+void UninstallCrashHandler()
+{
+    std::lock_guard<std::mutex> lock(s_crashInstallMtx);
+    if (!s_crashInstalled)
+    {
+        return;
+    }
+    for (size_t i = 0; i < std::size(kCrashSignals); ++i)
+    {
+        RestoreSignal(i);
     }
+    std::set_terminate(s_previousTerminate);
+    s_crashFd.store(-1, std::memory_order_release);
+    s_crashInstalled = false;
 }
 
 } // namespace QLog
@@ -0,0 +1,306 @@
+#include "QLog.h"
+
+#include <cstdio>
+#include <filesystem>
+
+#if defined(_WIN32)
+#  ifndef WIN32_LEAN_AND_MEAN
+#    define WIN32_LEAN_AND_MEAN
+#  endif
+#  ifndef NOMINMAX
+#    define NOMINMAX
+#  endif
+#  include <windows.h>
+#elif defined(__linux__)
+#  include <sys/resource.h>
+#  include <sys/syscall.h>
+#  include <unistd.h>
+#endif
+
+#if defined(QLOG_HAVE_ZLIB)
+#  include <zlib.h>
+#endif
+
+namespace QLog
+{
+
+namespace
+{
+    std::string SegmentName(const std::string& basePath, std::uint64_t index)
+    {
+        return basePath + "." + std::to_string(index);
+    }
+
+    // Continues numbering after the highest existing "<base>.N" or "<base>.N.gz"
+    std::uint64_t FirstSegmentIndex(const std::string& basePath)
+    {
+        namespace fs = std::filesystem;
+        const fs::path base(basePath);
+        const std::string prefix = base.filename().string() + ".";
+        fs::path dir = base.parent_path();
+        if (dir.empty())
+        {
+            dir = ".";
+        }
+
+        std::uint64_t highest = 0;
+        std::error_code ec;
+        for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec))
+        {
+            const std::string name = it->path().filename().string();
+            if (name.compare(0, prefix.size(), prefix) != 0)
+            {
+                continue;
+            }
+            std::uint64_t index = 0;
+            size_t pos = prefix.size();
+            while (pos < name.size() && name[pos] >= '0' && name[pos] <= '9')
+            {
+                index = index * 10 + static_cast<std::uint64_t>(name[pos] - '0');
+                ++pos;
+            }
+            const std::string_view rest = std::string_view(name).substr(pos);
+            if (pos > prefix.size() && (rest.empty() || rest == ".gz") && index > highest)
+            {
+                highest = index;
+            }
+        }
+        return highest + 1;
+    }
+
+    std::chrono::system_clock::time_point NextBoundary(std::chrono::system_clock::time_point now,
+                                                       std::chrono::seconds interval)
+    {
+        const auto secs = std::chrono::duration_cast<std::chrono::seconds>(now.time_since_epoch());
+        return std::chrono::system_clock::time_point((secs / interval + 1) * interval);
+    }
+
+    void LowerThreadPriority()
+    {
+#if defined(_WIN32)
+        ::SetThreadPriority(::GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+#elif defined(__linux__)
+        // Linux applies nice values per thread
+        ::setpriority(PRIO_PROCESS, static_cast<id_t>(::syscall(SYS_gettid)), 19);
+#endif
+    }
+
+    void GzipSegment(const std::string& path)
+    {
+#if defined(QLOG_HAVE_ZLIB)
+        std::FILE* in = std::fopen(path.c_str(), "rb");
+        if (!in)
+        {
+            return;
+        }
+        const std::string outPath = path + ".gz";
+        gzFile out = gzopen(outPath.c_str(), "wb6");
+        bool ok = out != nullptr;
+        char chunk[64 * 1024];
+        size_t n;
+        while (ok && (n = std::fread(chunk, 1, sizeof(chunk), in)) > 0)
+        {
+            ok = gzwrite(out, chunk, static_cast<unsigned>(n)) == static_cast<int>(n);
+        }
+        std::fclose(in);
+        if (out && gzclose(out) != Z_OK)
+        {
+            ok = false;
+        }
+        std::error_code ec;
+        std::filesystem::remove(ok ? path : outPath, ec);
+#else
+        (void)path; // built without zlib: leave the segment as is
+#endif
+    }
+}
+
+RotatingFileSink::RotatingFileSink(const std::string& basePath, RotationOptions options)
+    : RotatingFileSink(basePath, std::move(options), FirstSegmentIndex(basePath))
+{}
+
+RotatingFileSink::RotatingFileSink(const std::string& basePath, RotationOptions options, std::uint64_t firstIndex)
+    : FileSink(SegmentName(basePath, firstIndex), options.bufferSize, false, options.io),
+      m_basePath(basePath),
+      m_options(std::move(options)),
+      m_index(firstIndex)
+{
+    if (m_options.interval.count() > 0)
+    {
+        m_nextBoundary = NextBoundary(std::chrono::system_clock::now(), m_options.interval);
+    }
+    m_housekeeper = std::thread([this]
+    {
+        Housekeeper();
+    });
+}
+
+RotatingFileSink::~RotatingFileSink()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_stop = true;
+    }
+    m_cv.notify_one();
+    if (m_housekeeper.joinable())
+    {
+        m_housekeeper.join();
+    }
+    // The pre-opened segment was never written
+    if (m_nextFile)
+    {
+        m_nextFile->Close();
+        std::error_code ec;
+        std::filesystem::remove(SegmentPath(m_index + 1), ec);
+    }
+}
+
+void RotatingFileSink::Write(const Message& message)
+{
+    WriteBatch(&message, 1);
+}
+
+void RotatingFileSink::WriteBatch(const Message* messages, size_t count)
+{
+    const auto now = std::chrono::system_clock::now(); // one clock read per batch
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (RotationDue(now))
+        {
+            Rotate(now);
+        }
+        Append(messages[i]);
+    }
+}
+
+std::string RotatingFileSink::CurrentPath() const
+{
+    std::lock_guard<std::mutex> lock(m_mtx);
+    return SegmentPath(m_index);
+}
+
+bool RotatingFileSink::RotationDue(std::chrono::system_clock::time_point now) const
+{
+    if (m_options.maxBytes != 0 && BytesWritten() >= m_options.maxBytes)
+    {
+        return true;
+    }
+    return m_options.interval.count() > 0 && now >= m_nextBoundary;
+}
+
+void RotatingFileSink::Rotate(std::chrono::system_clock::time_point now)
+{
+    if (m_options.interval.count() > 0)
+    {
+        m_nextBoundary = NextBoundary(now, m_options.interval);
+    }
+    if (BytesWritten() == 0)
+    {
+        return; // never leave empty segments behind for idle intervals
+    }
+
+    File next;
+    std::uint64_t index;
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        if (m_nextFile)
+        {
+            next = std::move(*m_nextFile);
+            m_nextFile.reset();
+        }
+        index = m_index;
+    }
+    if (!next.IsOpen())
+    {
+        next = File(SegmentPath(index + 1)); // housekeeper has not caught up yet
+    }
+
+    File finished = ReplaceFile(std::move(next));
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_finished.emplace_back(std::move(finished), SegmentPath(index));
+        m_index = index + 1;
+        m_prepareNext = true;
+    }
+    m_cv.notify_one();
+}
+
+void RotatingFileSink::Housekeeper()
+{
+    LowerThreadPriority();
+
+    std::unique_lock<std::mutex> lock(m_mtx);
+    for (;;)
+    {
+        m_cv.wait(lock, [&]
+        {
+            return m_stop || m_prepareNext || !m_finished.empty();
+        });
+
+        if (m_prepareNext && !m_stop)
+        {
+            m_prepareNext = false;
+            const std::uint64_t index = m_index + 1;
+            lock.unlock();
+            File file;
+            try
+            {
+                file = File(SegmentPath(index));
+            }
+            catch (...)
+            {
+                // Rotate() opens the segment itself if this failed
+            }
+            lock.lock();
+            // Rotate() may have opened that segment itself and moved on while
+            // the lock was dropped; a stale handle would later be taken for the
+            // next segment while actually pointing at the current one
+            if (file.IsOpen() && index == m_index + 1 && !m_nextFile)
+            {
+                m_nextFile = std::move(file);
+            }
+            else if (file.IsOpen())
+            {
+                lock.unlock();
+                file.Close(); // the path is in use, so leave it in place
+                lock.lock();
+            }
+        }
+
+        while (!m_finished.empty())
+        {
+            // In the order they closed, so a backlog never leaves older segments behind
+            auto segment = std::move(m_finished.front());
+            m_finished.pop_front();
+            lock.unlock();
+            segment.first.Close();
+            try
+            {
+                if (m_options.onSegmentClosed)
+                {
+                    m_options.onSegmentClosed(segment.second);
+                }
+                else if (m_options.compression == Compression::Gzip)
+                {
+                    GzipSegment(segment.second);
+                }
+            }
+            catch (...)
+            {
+            }
+            lock.lock();
+        }
+
+        if (m_stop)
+        {
+            break;
+        }
+    }
+}
+
+std::string RotatingFileSink::SegmentPath(std::uint64_t index) const
+{
+    return SegmentName(m_basePath, index);
+}
+
+} // namespace QLog
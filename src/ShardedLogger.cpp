@@ -0,0 +1,158 @@
+#include "QLog.h"
+
+#include <fstream>
+#include <ostream>
+#include <queue>
+#include <stdexcept>
+
+namespace QLog
+{
+
+namespace
+{
+    // Sequential per-thread number, so threads spread evenly over the shards
+    size_t ThreadOrdinal()
+    {
+        static std::atomic<size_t> s_nextOrdinal{0};
+        thread_local const size_t t_ordinal = s_nextOrdinal.fetch_add(1, std::memory_order_relaxed);
+        return t_ordinal;
+    }
+
+    // The "[...]" prefix FormatRecord writes; empty when the record has no timestamp
+    std::string_view TimestampKey(const std::string& line)
+    {
+        if (line.empty() || line.front() != '[')
+        {
+            return {};
+        }
+        const auto end = line.find(']');
+        return end == std::string::npos ? std::string_view{} : std::string_view(line).substr(0, end + 1);
+    }
+}
+
+ShardedLogger::ShardedLogger(const std::vector<Sink*>& sinks, const LoggerOptions& options)
+    : m_level(options.level)
+{
+    if (sinks.empty())
+    {
+        throw std::invalid_argument("QLog: ShardedLogger needs at least one sink");
+    }
+    m_shards.reserve(sinks.size());
+    for (Sink* sink : sinks)
+    {
+        if (!sink)
+        {
+            throw std::invalid_argument("QLog: ShardedLogger sink must not be null");
+        }
+        m_shards.push_back(std::make_unique<Logger>(*sink, options));
+    }
+}
+
+Logger& ShardedLogger::Local()
+{
+    return *m_shards[ThreadOrdinal() % m_shards.size()];
+}
+
+void ShardedLogger::Log(Level level, const char* format, ...)
+{
+    if (!IsEnabled(level))
+    {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    Local().Log(level, format, args);
+    va_end(args);
+}
+
+void ShardedLogger::Flush()
+{
+    for (auto& shard : m_shards)
+    {
+        shard->Flush();
+    }
+}
+
+void ShardedLogger::Shutdown()
+{
+    for (auto& shard : m_shards)
+    {
+        shard->Shutdown();
+    }
+}
+
+void ShardedLogger::SetLevel(Level level)
+{
+    m_level.store(level, std::memory_order_relaxed);
+    for (auto& shard : m_shards)
+    {
+        shard->SetLevel(level);
+    }
+}
+
+bool MergeLogFiles(const std::vector<std::string>& paths, std::ostream& out)
+{
+    std::vector<std::ifstream> inputs;
+    inputs.reserve(paths.size());
+    for (const auto& path : paths)
+    {
+        inputs.emplace_back(path, std::ios::binary);
+        if (!inputs.back())
+        {
+            return false;
+        }
+    }
+
+    // k-way merge on the fixed-width timestamp prefix, which sorts lexically.
+    // A line without one (continuation of a multi-line message) keeps the key
+    // of the line before it, so it stays with its record.
+    struct Head
+    {
+        std::string line;
+        std::string key;
+        size_t input;
+    };
+    auto later = [](const Head& a, const Head& b) { return a.key != b.key ? a.key > b.key : a.input > b.input; };
+    auto advance = [&inputs](Head& head)
+    {
+        if (!std::getline(inputs[head.input], head.line))
+        {
+            return false;
+        }
+        const auto key = TimestampKey(head.line);
+        if (!key.empty())
+        {
+            head.key.assign(key);
+        }
+        return true;
+    };
+    std::priority_queue<Head, std::vector<Head>, decltype(later)> heads(later);
+    for (size_t i = 0; i < inputs.size(); ++i)
+    {
+        Head head{{}, {}, i};
+        if (advance(head))
+        {
+            heads.push(std::move(head));
+        }
+    }
+    while (!heads.empty())
+    {
+        Head head = heads.top();
+        heads.pop();
+        out << head.line << '\n';
+        // Drain the rest of this record before the other inputs get a turn
+        bool more = advance(head);
+        while (more && TimestampKey(head.line).empty())
+        {
+            out << head.line << '\n';
+            more = advance(head);
+        }
+        if (more)
+        {
+            heads.push(std::move(head));
+        }
+    }
+    return static_cast<bool>(out);
+}
+
+} // namespace QLog
@@ -1,9 +1,42 @@
 #include <gtest/gtest.h>
 #include "QLog.h"
 
+#include <algorithm>
 #include <chrono>
+#include <cstdio>
+#include <condition_variable>
+#include <csignal>
+#include <exception>
+#include <iostream>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
 #include <sstream>
 #include <thread>
+#include <vector>
+
+#if defined(QLOG_HAVE_ZLIB)
+#  include <zlib.h>
+#endif
+
+#if defined(__linux__) && defined(__GLIBC__)
+#  include <cerrno>
+#  include <cstdarg>
+#  include <dlfcn.h>
+#  include <fcntl.h>
+#  include <linux/io_uring.h>
+#  include <sys/stat.h>
+#  include <sys/syscall.h>
+#  define QLOG_TEST_URING_FAULTS 1
+#endif
+
+#if !defined(_WIN32)
+#  include <poll.h>
+#  include <sys/socket.h>
+#  include <sys/time.h>
+#  include <sys/un.h>
+#  include <unistd.h>
+#endif
 
 // Avoid using-directives; use fully qualified std::chrono types
 
@@ -17,9 +50,6 @@ TEST(QLog, BasicWriteAndFlush)
     logger.Warn("world");
     logger.Flush();
 
-    // Give worker some time to process
-    std::this_thread::sleep_for(std::chrono::milliseconds(50));
-
     auto s = oss.str();
     // Expect a timestamp prefix like: [YYYY-mm-dd HH:MM:SS.uuuuuu]
     ASSERT_FALSE(s.empty());
@@ -37,34 +67,12 @@ TEST(QLog, LevelFiltering)
     logger.Info("won't show");
     logger.Error("shows");
     logger.Flush();
-    std::this_thread::sleep_for(std::chrono::milliseconds(50));
 
     auto s = oss.str();
     EXPECT_EQ(s.find("] INFO: "), std::string::npos);
     EXPECT_NE(s.find("] ERROR: shows"), std::string::npos);
 }
 
-TEST(QLog, BoundedCapacityDropsOldest)
-{
-    std::ostringstream oss;
-    QLog::OStreamSink sink(oss);
-    QLog::Logger logger{sink, QLog::Level::Trace, 3};
-
-    logger.Info("a");
-    logger.Info("b");
-    logger.Info("c");
-    logger.Info("d"); // should drop 'a'
-
-    logger.Flush();
-    std::this_thread::sleep_for(std::chrono::milliseconds(50));
-    auto s = oss.str();
-
-    EXPECT_EQ(s.find("] INFO: a"), std::string::npos);
-    EXPECT_NE(s.find("] INFO: b"), std::string::npos);
-    EXPECT_NE(s.find("] INFO: c"), std::string::npos);
-    EXPECT_NE(s.find("] INFO: d"), std::string::npos);
-}
-
 TEST(QLog, TimestampsCanBeDisabled)
 {
     std::ostringstream oss;
@@ -76,7 +84,6 @@ TEST(QLog, TimestampsCanBeDisabled)
     logger.Info("no ts 1");
     logger.Warn("no ts 2");
     logger.Flush();
-    std::this_thread::sleep_for(std::chrono::milliseconds(50));
 
     const auto s = oss.str();
     // Should not start with '[' when timestamps are disabled
@@ -103,7 +110,6 @@ TEST(QLog, PrintfStyleFormattingAndFiltering)
     logger.Debug("This debug message with %s should be filtered", "args");
     
     logger.Flush();
-    std::this_thread::sleep_for(std::chrono::milliseconds(50));
 
     auto s = oss.str();
     EXPECT_NE(s.find("] INFO: User alice logged in with ID 123"), std::string::npos);
@@ -130,7 +136,6 @@ TEST(QLog, BreaksCanThrowForTesting)
     logger.EnableBreaks(false);
     logger.Error("after");
     logger.Flush();
-    std::this_thread::sleep_for(std::chrono::milliseconds(50));
     auto s = oss.str();
     EXPECT_NE(s.find("ERROR: after"), std::string::npos);
 }
@@ -160,4 +165,2308 @@ TEST(QLog, FormatTimestamp)
     // Should have expected format: "[2024-09-27 07:10:15.123456] " (29 chars)
     EXPECT_EQ(formatted.length(), 29u);
     EXPECT_EQ(formatted, "[2024-09-27 07:10:15.123456] ");
-}
\ No newline at end of file
+}
+
+namespace
+{
+    // Sink that parks the worker inside the first Write until Open() is called,
+    // so tests can fill the queue deterministically
+    class GatedSink : public QLog::Sink
+    {
+    public:
+        explicit GatedSink(std::ostream& os) : m_inner(os) {}
+
+        void Write(const QLog::Message& message) override
+        {
+            std::unique_lock<std::mutex> lock(m_mtx);
+            m_entered = true;
+            m_cv.notify_all();
+            m_cv.wait(lock, [&] { return m_open; });
+            m_inner.Write(message);
+        }
+        void Flush() override { m_inner.Flush(); }
+
+        void WaitUntilEntered()
+        {
+            std::unique_lock<std::mutex> lock(m_mtx);
+            m_cv.wait(lock, [&] { return m_entered; });
+        }
+        void Open()
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            m_open = true;
+            m_cv.notify_all();
+        }
+
+    private:
+        QLog::OStreamSink m_inner;
+        std::mutex m_mtx;
+        std::condition_variable m_cv;
+        bool m_entered{false};
+        bool m_open{false};
+    };
+}
+
+#if GTEST_HAS_DEATH_TEST && !defined(_WIN32)
+TEST(QLog, CrashHandlerWritesQueuedRecords)
+{
+    GTEST_FLAG_SET(death_test_style, "threadsafe");
+    for (auto mode : {QLog::QueueMode::Locked, QLog::QueueMode::LockFree, QLog::QueueMode::PerThread})
+    {
+        auto crash = [mode](bool terminate)
+        {
+            std::ostringstream oss;
+            GatedSink sink(oss);
+            QLog::LoggerOptions options;
+            options.queueMode = mode;
+            options.crashDrain = true;
+            QLog::Logger logger{sink, options};
+            QLog::InstallCrashHandler(2);
+            // The worker is stuck in the sink, so these never get written normally
+            logger.Info("first");
+            sink.WaitUntilEntered();
+            logger.Warn("queued %d", 1);
+            logger.LogDeferred(QLog::Level::Error, "deferred %d", 2);
+            if (terminate)
+            {
+                std::terminate();
+            }
+            std::raise(SIGSEGV);
+        };
+        EXPECT_DEATH(crash(false), "Z\\] WARN: queued 1\n\\[[-0-9 :.]*Z\\] ERROR: deferred %d \\[unrendered\\]");
+        EXPECT_DEATH(crash(true), "WARN: queued 1");
+    }
+}
+
+TEST(QLog, DebugBreakFlushesBeforeTrapping)
+{
+    GTEST_FLAG_SET(death_test_style, "threadsafe");
+    auto trap = []
+    {
+        QLog::OStreamSink sink(std::cerr);
+        QLog::Logger logger{sink, QLog::Level::Trace};
+        logger.SetBreakLevel(QLog::Level::Error);
+        logger.EnableBreaks(true);
+        logger.Info("before the break");
+        logger.Error("breaks at %d", 1);
+    };
+    EXPECT_DEATH(trap(), "INFO: before the break\n.*ERROR: breaks at 1\n");
+
+    auto trapDeferred = []
+    {
+        QLog::OStreamSink sink(std::cerr);
+        QLog::Logger logger{sink, QLog::Level::Trace};
+        logger.SetBreakLevel(QLog::Level::Critical);
+        logger.EnableBreaks(true);
+        logger.LogDeferred(QLog::Level::Critical, "deferred break %d", 2);
+    };
+    EXPECT_DEATH(trapDeferred(), "CRITICAL: deferred break 2\n");
+}
+#endif
+
+#if !defined(_WIN32)
+TEST(QLog, EmergencyDrainFreezesRecordStorage)
+{
+    int fds[2];
+    ASSERT_EQ(::pipe(fds), 0);
+    for (auto mode : {QLog::QueueMode::Locked, QLog::QueueMode::LockFree, QLog::QueueMode::PerThread})
+    {
+        std::ostringstream oss;
+        GatedSink sink(oss);
+        QLog::LoggerOptions options;
+        options.queueMode = mode;
+        options.arenaSize = 4096;
+        options.crashDrain = true;
+        QLog::Logger logger{sink, options};
+        logger.EnableTimestamps(false);
+
+        logger.Info("first");
+        sink.WaitUntilEntered();
+        logger.Warn("queued");
+        EXPECT_EQ(logger.EmergencyDrain(fds[1]), 1u);
+        char buffer[256];
+        const ssize_t n = ::read(fds[0], buffer, sizeof(buffer));
+        EXPECT_EQ(std::string(buffer, n > 0 ? static_cast<size_t>(n) : 0), "WARN: queued\n");
+
+        // Written records are no longer freed, so the arena runs dry where it
+        // would otherwise be reused record after record
+        sink.Open();
+        for (int i = 0; i < 100; ++i)
+        {
+            logger.Info("after %d %s", i, std::string(100, 'f').c_str());
+            logger.Flush();
+        }
+        const auto stats = logger.GetStats();
+        EXPECT_GT(stats.heapAllocations, 0u);
+        EXPECT_EQ(stats.written, 102u);
+    }
+
+    // Only Loggers that opted in can be drained
+    std::ostringstream oss;
+    QLog::OStreamSink sink(oss);
+    QLog::Logger logger{sink};
+    logger.Info("not drained");
+    EXPECT_EQ(logger.EmergencyDrain(fds[1]), 0u);
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
+#endif
+
+TEST(QLog, BoundedCapacityDropsOldest)
+{
+    std::ostringstream oss;
+    GatedSink sink(oss);
+    QLog::Logger logger{sink, QLog::Level::Trace, 3};
+
+    // Park the worker so all four records meet a full queue
+    logger.Info("first");
+    sink.WaitUntilEntered();
+    logger.Info("a");
+    logger.Info("b");
+    logger.Info("c");
+    logger.Info("d"); // should drop 'a'
+
+    sink.Open();
+    logger.Flush();
+    auto s = oss.str();
+
+    EXPECT_EQ(s.find("] INFO: a"), std::string::npos);
+    EXPECT_NE(s.find("] INFO: b"), std::string::npos);
+    EXPECT_NE(s.find("] INFO: c"), std::string::npos);
+    EXPECT_NE(s.find("] INFO: d"), std::string::npos);
+}
+
+TEST(QLog, LockFreeQueueDropsOldest)
+{
+    std::ostringstream oss;
+    GatedSink sink(oss);
+    QLog::LoggerOptions options;
+    options.level = QLog::Level::Trace;
+    options.capacity = 3;
+    options.queueMode = QLog::QueueMode::LockFree;
+    QLog::Logger logger{sink, options};
+    EXPECT_EQ(logger.GetCapacity(), 3u);
+
+    logger.Info("first");
+    sink.WaitUntilEntered();
+    logger.Info("a");
+    logger.Info("b");
+    logger.Info("c");
+    logger.Info("d"); // should drop 'a'
+    sink.Open();
+
+    logger.Flush();
+    auto s = oss.str();
+
+    EXPECT_NE(s.find("] INFO: first"), std::string::npos);
+    EXPECT_EQ(s.find("] INFO: a"), std::string::npos);
+    EXPECT_NE(s.find("] INFO: b"), std::string::npos);
+    EXPECT_NE(s.find("] INFO: d"), std::string::npos);
+}
+
+TEST(QLog, LockFreeQueueManyProducers)
+{
+    std::ostringstream oss;
+    QLog::OStreamSink sink(oss);
+    QLog::LoggerOptions options;
+    options.level = QLog::Level::Trace;
+    options.capacity = 1 << 14;
+    options.queueMode = QLog::QueueMode::LockFree;
+
+    constexpr int kThreads = 8;
+    constexpr int kPerThread = 500;
+    {
+        QLog::Logger logger{sink, options};
+        std::vector<std::thread> threads;
+        for (int t = 0; t < kThreads; ++t)
+        {
+            threads.emplace_back([t, &logger]
+            {
+                for (int n = 0; n < kPerThread; ++n)
+                {
+                    logger.Info("t%d n%d", t, n);
+                }
+            });
+        }
+        for (auto& th : threads)
+        {
+            th.join();
+        }
+        logger.Shutdown();
+    }
+
+    const auto s = oss.str();
+    size_t lines = 0;
+    for (char c : s)
+    {
+        lines += (c == '\n');
+    }
+    EXPECT_EQ(lines, static_cast<size_t>(kThreads * kPerThread));
+    EXPECT_NE(s.find("INFO: t7 n499"), std::string::npos);
+}
+
+TEST(QLog, PerThreadQueuesMergeByTimestamp)
+{
+    std::ostringstream oss;
+    GatedSink sink(oss);
+    QLog::LoggerOptions options;
+    options.level = QLog::Level::Trace;
+    options.queueMode = QLog::QueueMode::PerThread;
+    QLog::Logger logger{sink, options};
+
+    logger.Info("first");
+    sink.WaitUntilEntered();
+
+    // Interleave two producer threads in strict order while the worker is parked
+    std::thread([&] { logger.Info("one"); }).join();
+    logger.Info("two");
+    std::thread([&] { logger.Info("three"); }).join();
+    sink.Open();
+    logger.Shutdown();
+
+    const auto s = oss.str();
+    const auto one = s.find("INFO: one");
+    const auto two = s.find("INFO: two");
+    const auto three = s.find("INFO: three");
+    ASSERT_NE(one, std::string::npos);
+    ASSERT_NE(two, std::string::npos);
+    ASSERT_NE(three, std::string::npos);
+    EXPECT_LT(one, two);
+    EXPECT_LT(two, three);
+}
+
+TEST(QLog, LongMessagesFallBackToHeap)
+{
+    std::ostringstream oss;
+    QLog::OStreamSink sink(oss);
+    QLog::Logger logger{sink, QLog::Level::Trace};
+
+    const std::string exact(495, 'x'); // just fits the first-pass reservation
+    const std::string longer(2000, 'y');
+    logger.Info("%s", exact.c_str());
+    logger.Info("%s|end", longer.c_str());
+    logger.Flush();
+
+    const auto s = oss.str();
+    EXPECT_NE(s.find("INFO: " + exact + "\n"), std::string::npos);
+    EXPECT_NE(s.find("INFO: " + longer + "|end\n"), std::string::npos);
+}
+
+TEST(QLog, DeferredFormattingRendersOnWorker)
+{
+    std::ostringstream oss;
+    QLog::OStreamSink sink(oss);
+    QLog::Logger logger{sink, QLog::Level::Info};
+
+    {
+        // Temporaries must be copied at the call, not referenced
+        std::string user = "alice";
+        logger.LogDeferred(QLog::Level::Info, "User %s id %d ratio %.2f tag %s", user, 123, 0.5f, "t1");
+        user.assign("clobbered");
+    }
+    logger.LogDeferred(QLog::Level::Warn, "no args, 100%%");
+    logger.LogDeferred(QLog::Level::Debug, "filtered %d", 1);
+    logger.Flush();
+
+    const auto s = oss.str();
+    EXPECT_NE(s.find("] INFO: User alice id 123 ratio 0.50 tag t1"), std::string::npos);
+    EXPECT_NE(s.find("] WARN: no args, 100%"), std::string::npos);
+    EXPECT_EQ(s.find("filtered"), std::string::npos);
+}
+
+TEST(QLog, DeferredRecordsReachAcceptingSinkUnrendered)
+{
+    struct CaptureSink : QLog::Sink
+    {
+        void Write(const QLog::Message& message) override
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            deferred = message.IsDeferred() && message.text.empty();
+            format = message.format;
+            text = std::string(QLog::RenderText(message, buffer));
+        }
+        bool AcceptsDeferred() const override { return true; }
+
+        std::mutex mtx;
+        bool deferred{false};
+        const char* format{nullptr};
+        std::string text;
+        std::string buffer;
+    };
+
+    static const char kFormat[] = "%s=%llu";
+    CaptureSink sink;
+    {
+        QLog::Logger logger{sink, QLog::Level::Info};
+        logger.LogDeferred(QLog::Level::Info, kFormat, std::string_view("bytes"), 42ull);
+    }
+
+    std::lock_guard<std::mutex> lock(sink.mtx);
+    EXPECT_TRUE(sink.deferred);
+    EXPECT_EQ(sink.format, kFormat);
+    EXPECT_EQ(sink.text, "bytes=42");
+}
+
+TEST(QLog, CompileTimeFormatChecks)
+{
+    using QLog::Detail::CheckFormatFor;
+    using QLog::Detail::FormatError;
+
+    static_assert(CheckFormatFor<int, const char*, double>("%d %s %.2f") == FormatError::None);
+    static_assert(CheckFormatFor<long long, size_t, std::string>("%lld %zu %s") == FormatError::None);
+    static_assert(CheckFormatFor<int, int>("%*d 100%%") == FormatError::None);
+    static_assert(CheckFormatFor<long long>("%d") == FormatError::TypeMismatch);
+    static_assert(CheckFormatFor<int>("%s") == FormatError::TypeMismatch);
+    static_assert(CheckFormatFor<double>("%d") == FormatError::TypeMismatch);
+    static_assert(CheckFormatFor<int>("%d %d") == FormatError::TooFewArguments);
+    static_assert(CheckFormatFor<int, int>("%d") == FormatError::TooManyArguments);
+    static_assert(CheckFormatFor<int*>("%n") == FormatError::UnsupportedConversion);
+    SUCCEED();
+}
+
+TEST(QLog, DeferredCallSiteMacro)
+{
+    std::ostringstream oss;
+    QLog::OStreamSink sink(oss);
+    QLog::Logger logger{sink, QLog::Level::Info};
+
+    const std::string path = "/index";
+    QLOG_DEFERRED(logger, QLog::Level::Info, "GET %s -> %d in %.1f ms", path, 200, 1.25);
+    QLOG_DEFERRED(logger, QLog::Level::Error, "plain text");
+    logger.Flush();
+
+    const auto s = oss.str();
+    EXPECT_NE(s.find("] INFO: GET /index -> 200 in 1.2 ms"), std::string::npos);
+    EXPECT_NE(s.find("] ERROR: plain text"), std::string::npos);
+}
+
+TEST(QLog, LevelMacrosSkipFilteredArguments)
+{
+    std::ostringstream oss;
+    QLog::OStreamSink sink(oss);
+    QLog::Logger logger{sink, QLog::Level::Info};
+
+    int evaluated = 0;
+    auto next = [&evaluated] { return ++evaluated; };
+    QLOG_TRACE(logger, "trace %d", next());
+    QLOG_DEBUG(logger, "debug %d", next());
+    QLOG_INFO(logger, "info %d", next());
+    QLOG_CRITICAL(logger, "critical %d", next());
+    EXPECT_EQ(evaluated, 2);
+    EXPECT_TRUE(logger.IsEnabled(QLog::Level::Warn));
+    EXPECT_FALSE(logger.IsEnabled(QLog::Level::Debug));
+    logger.Flush();
+
+    const auto s = oss.str();
+    EXPECT_EQ(s.find("trace"), std::string::npos);
+    EXPECT_EQ(s.find("debug"), std::string::npos);
+    EXPECT_NE(s.find("] INFO: info 1\n"), std::string::npos);
+    EXPECT_NE(s.find("] CRITICAL: critical 2\n"), std::string::npos);
+}
+
+TEST(QLog, CallSiteSwitchForcesSingleSites)
+{
+    std::ostringstream oss;
+    QLog::OStreamSink sink(oss);
+    QLog::Logger logger{sink, QLog::Level::Error};
+
+    // A site enabled before it first runs picks the setting up on registration
+    const int early = __LINE__ + 4;
+    EXPECT_EQ(QLog::EnableCallSites("QLogTests.cpp", early), 0u);
+    for (int i = 0; i < 3; ++i)
+    {
+        QLOG_DEBUG(logger, "early %d", i);
+        QLOG_TRACE(logger, "neighbor %d", i);
+        if (i == 0)
+        {
+            // The neighbor is registered now; force it only from here on
+            EXPECT_EQ(QLog::EnableCallSites("tests/QLogTests.cpp", early + 1), 1u);
+        }
+    }
+    EXPECT_EQ(QLog::EnableCallSites("QLogTests.cpp", early, false), 1u);
+    EXPECT_EQ(QLog::EnableCallSites("QLogTests.cpp", early + 1, false), 1u);
+    QLOG_DEBUG(logger, "unmatched %d", 0);
+    logger.Flush();
+
+    const auto s = oss.str();
+    EXPECT_NE(s.find("] DEBUG: early 0\n"), std::string::npos);
+    EXPECT_NE(s.find("] DEBUG: early 2\n"), std::string::npos);
+    EXPECT_EQ(s.find("neighbor 0"), std::string::npos);
+    EXPECT_NE(s.find("] TRACE: neighbor 1\n"), std::string::npos);
+    EXPECT_NE(s.find("] TRACE: neighbor 2\n"), std::string::npos);
+    EXPECT_EQ(s.find("unmatched"), std::string::npos);
+}
+
+TEST(QLog, LimitedSitesSuppressBeforeFormatting)
+{
+    std::ostringstream oss;
+    QLog::OStreamSink sink(oss);
+    QLog::Logger logger{sink, QLog::Level::Info};
+
+    int evaluated = 0;
+    auto next = [&evaluated] { return ++evaluated; };
+    const int sampledLine = __LINE__ + 3;
+    for (int i = 0; i < 10; ++i)
+    {
+        QLOG_SAMPLED(logger, QLog::Level::Warn, 4, "sampled %d", next());
+        QLOG_SAMPLED(logger, QLog::Level::Debug, 1, "filtered %d", next());
+    }
+    EXPECT_EQ(evaluated, 3); // calls 0, 4 and 8
+
+    // 5 per second from a full bucket of 3: a quick run of 10 keeps the first 3
+    const int limitedLine = __LINE__ + 1;
+    const auto rateLimited = [&] { QLOG_RATE_LIMITED(logger, QLog::Level::Error, 5, 3, "limited %d", next()); };
+    for (int i = 0; i < 10; ++i)
+    {
+        rateLimited();
+    }
+    EXPECT_EQ(evaluated, 6);
+    std::this_thread::sleep_for(std::chrono::milliseconds(250)); // refills one token
+    rateLimited();
+    EXPECT_EQ(evaluated, 7);
+    logger.Flush();
+
+    std::vector<std::string> lines;
+    std::istringstream in(oss.str());
+    for (std::string line; std::getline(in, line);)
+    {
+        lines.push_back(line.substr(line.find("] ") + 2));
+    }
+    const std::string where = std::string(" at ") + __FILE__ + ":";
+    const std::vector<std::string> expected{
+        "WARN: sampled 1",
+        "WARN: suppressed 3 messages" + where + std::to_string(sampledLine),
+        "WARN: sampled 2",
+        "WARN: suppressed 3 messages" + where + std::to_string(sampledLine),
+        "WARN: sampled 3",
+        "ERROR: limited 4",
+        "ERROR: limited 5",
+        "ERROR: limited 6",
+        "ERROR: suppressed 7 messages" + where + std::to_string(limitedLine),
+        "ERROR: limited 7",
+    };
+    EXPECT_EQ(lines, expected);
+}
+
+TEST(QLog, WorkerDeliversBatches)
+{
+    struct BatchSink : QLog::Sink
+    {
+        void Write(const QLog::Message& message) override
+        {
+            WriteBatch(&message, 1);
+        }
+        void WriteBatch(const QLog::Message* messages, size_t count) override
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            batches.push_back(count);
+            for (size_t i = 0; i < count; ++i)
+            {
+                texts.emplace_back(messages[i].text);
+            }
+        }
+
+        std::mutex mtx;
+        std::vector<size_t> batches;
+        std::vector<std::string> texts;
+    };
+
+    BatchSink sink;
+    {
+        QLog::Logger logger{sink, QLog::Level::Info};
+        // Plain and deferred records share a batch; each keeps its own text
+        for (int i = 0; i < 100; ++i)
+        {
+            if (i % 2)
+            {
+                logger.LogDeferred(QLog::Level::Info, "deferred %d", i);
+            }
+            else
+            {
+                logger.Info("plain %d", i);
+            }
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(sink.mtx);
+    ASSERT_EQ(sink.texts.size(), 100u);
+    for (int i = 0; i < 100; ++i)
+    {
+        EXPECT_EQ(sink.texts[i], (i % 2 ? "deferred " : "plain ") + std::to_string(i));
+    }
+    size_t total = 0;
+    for (size_t n : sink.batches)
+    {
+        total += n;
+    }
+    EXPECT_EQ(total, 100u);
+}
+
+TEST(QLog, FileSinkWritesRecords)
+{
+    const auto path = (std::filesystem::temp_directory_path() / "qlog_filesink_test.log").string();
+    std::filesystem::remove(path);
+
+    const std::string big(1000, 'z');
+    {
+        // Small buffer so records overflow it and one record exceeds it entirely
+        QLog::FileSink sink(path, 256);
+        QLog::Logger logger{sink, QLog::Level::Info};
+        for (int i = 0; i < 20; ++i)
+        {
+            logger.Info("line %d", i);
+        }
+        logger.Warn("%s", big.c_str());
+        logger.EnableTimestamps(false);
+        logger.Error("last");
+    }
+
+    std::ifstream in(path);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    const auto s = ss.str();
+    EXPECT_NE(s.find("] INFO: line 0\n"), std::string::npos);
+    EXPECT_NE(s.find("] INFO: line 19\n"), std::string::npos);
+    EXPECT_NE(s.find("] WARN: " + big + "\n"), std::string::npos);
+    EXPECT_NE(s.find("\nERROR: last\n"), std::string::npos);
+    EXPECT_LT(s.find("line 19"), s.find("WARN"));
+    std::filesystem::remove(path);
+}
+
+namespace
+{
+    // Shared by the Async backends
+    void CheckAsyncFileSinkKeepsOrder(QLog::FileIo io)
+    {
+        const auto path = (std::filesystem::temp_directory_path() / "qlog_async_filesink_test.log").string();
+        std::filesystem::remove(path);
+
+        const std::string big(3000, 'q');
+        {
+            // Tiny buffers so many are in flight, plus records written around them
+            QLog::FileSink sink(path, 512, true, io);
+            QLog::Logger logger{sink, QLog::Level::Info};
+            logger.EnableTimestamps(false);
+            size_t bytes = 0;
+            for (int i = 0; i < 5000; ++i)
+            {
+                logger.Info("line %d", i);
+                bytes += std::string("INFO: line \n").size() + std::to_string(i).size();
+                if (i == 2500)
+                {
+                    logger.Warn("%s", big.c_str());
+                    bytes += std::string("WARN: \n").size() + big.size();
+                }
+            }
+            // Flush() returns only after the queued buffers are on disk
+            logger.Flush();
+            EXPECT_EQ(std::filesystem::file_size(path), bytes);
+            logger.Info("after flush");
+        }
+
+        std::ifstream in(path);
+        std::string line;
+        int expected = 0;
+        bool sawBig = false;
+        while (std::getline(in, line))
+        {
+            if (line == "WARN: " + big)
+            {
+                EXPECT_EQ(expected, 2501);
+                sawBig = true;
+                continue;
+            }
+            if (expected == 5000)
+            {
+                EXPECT_EQ(line, "INFO: after flush");
+                ++expected;
+                continue;
+            }
+            ASSERT_EQ(line, "INFO: line " + std::to_string(expected));
+            ++expected;
+        }
+        EXPECT_TRUE(sawBig);
+        EXPECT_EQ(expected, 5001);
+        std::filesystem::remove(path);
+    }
+}
+
+TEST(QLog, AsyncFileSinkKeepsOrderAcrossBuffers)
+{
+    CheckAsyncFileSinkKeepsOrder(QLog::FileIo::Async);
+}
+
+TEST(QLog, AsyncThreadFileSinkKeepsOrderAcrossBuffers)
+{
+    // Forces the portable I/O thread backend that Async falls back to
+    CheckAsyncFileSinkKeepsOrder(QLog::FileIo::AsyncThread);
+}
+
+#if defined(QLOG_TEST_URING_FAULTS)
+namespace
+{
+    enum class UringFault
+    {
+        None,
+        Submit, // the next io_uring_enter that submits
+        Wait    // every io_uring_enter that waits for completions
+    };
+    std::atomic<UringFault> g_uringFault{UringFault::None};
+    std::atomic<int> g_uringEnters{0};
+}
+
+// Stands in for libc's syscall() so the io_uring backend's enter calls can be
+// failed on demand; everything else is forwarded
+extern "C" long syscall(long number, ...) noexcept
+{
+    long a[6];
+    va_list args;
+    va_start(args, number);
+    for (auto& arg : a)
+    {
+        arg = va_arg(args, long);
+    }
+    va_end(args);
+    if (number == __NR_io_uring_enter)
+    {
+        g_uringEnters.fetch_add(1);
+        const bool waits = (a[3] & IORING_ENTER_GETEVENTS) != 0;
+        UringFault submit = UringFault::Submit;
+        if ((waits && g_uringFault.load() == UringFault::Wait) ||
+            (!waits && a[1] > 0 && g_uringFault.compare_exchange_strong(submit, UringFault::None)))
+        {
+            errno = EIO;
+            return -1;
+        }
+    }
+    using Syscall = long (*)(long, ...);
+    static const auto real = reinterpret_cast<Syscall>(::dlsym(RTLD_NEXT, "syscall"));
+    return real(number, a[0], a[1], a[2], a[3], a[4], a[5]);
+}
+
+TEST(QLog, UringSubmitFailureWritesEachBufferOnce)
+{
+    const auto path = (std::filesystem::temp_directory_path() / "qlog_uring_submit_test.log").string();
+    std::filesystem::remove(path);
+    {
+        g_uringEnters = 0;
+        QLog::FileSink sink(path, 512, true, QLog::FileIo::Async);
+        QLog::Message message;
+        message.level = QLog::Level::Info;
+        message.text = "before";
+        sink.Write(message);
+        sink.Flush();
+        if (g_uringEnters == 0)
+        {
+            GTEST_SKIP() << "io_uring is not available";
+        }
+        // The failed buffer is rewritten synchronously; its entry must not
+        // also be submitted later
+        g_uringFault = UringFault::Submit;
+        const std::string big(2000, 'u');
+        message.text = big;
+        sink.Write(message);
+        message.text = "after";
+        sink.Write(message);
+        sink.Flush();
+        EXPECT_EQ(g_uringFault.load(), UringFault::None);
+    }
+    const std::string expected = "INFO: before\nINFO: " + std::string(2000, 'u') + "\nINFO: after\n";
+    std::ifstream in(path);
+    std::stringstream contents;
+    contents << in.rdbuf();
+    EXPECT_EQ(contents.str(), expected);
+    std::filesystem::remove(path);
+}
+
+TEST(QLog, UringWaitFailureDoesNotHangFlush)
+{
+    // A FIFO nobody reads yet keeps the write in flight, so Flush has to wait
+    const auto path = (std::filesystem::temp_directory_path() / "qlog_uring_wait_test.fifo").string();
+    ::unlink(path.c_str());
+    ASSERT_EQ(::mkfifo(path.c_str(), 0600), 0);
+    const int reader = ::open(path.c_str(), O_RDONLY | O_NONBLOCK);
+    ASSERT_GE(reader, 0);
+
+    const std::string big(256 * 1024, 'w'); // well past the pipe's capacity
+    std::thread drain;
+    {
+        g_uringEnters = 0;
+        QLog::FileSink sink(path, big.size() + 64, false, QLog::FileIo::Async);
+        QLog::Message message;
+        message.level = QLog::Level::Info;
+        message.text = big;
+        sink.Write(message);
+        g_uringFault = UringFault::Wait;
+        bool threw = false;
+        try
+        {
+            sink.Flush();
+        }
+        catch (const std::system_error& e)
+        {
+            threw = true;
+            EXPECT_EQ(e.code().value(), EIO);
+        }
+        g_uringFault = UringFault::None;
+        if (g_uringEnters == 0)
+        {
+            ::close(reader);
+            ::unlink(path.c_str());
+            GTEST_SKIP() << "io_uring is not available";
+        }
+        EXPECT_TRUE(threw);
+
+        // Later buffers still go out, after the abandoned write
+        message.text = "after";
+        drain = std::thread([&]
+        {
+            ::fcntl(reader, F_SETFL, 0);
+            char buffer[4096];
+            while (::read(reader, buffer, sizeof(buffer)) > 0)
+            {
+            }
+        });
+        sink.Write(message);
+        sink.Flush();
+    }
+    drain.join();
+    ::close(reader);
+    ::unlink(path.c_str());
+}
+#endif
+
+TEST(QLog, RotatingFileSinkRotatesBySize)
+{
+    namespace fs = std::filesystem;
+    const auto dir = fs::temp_directory_path() / "qlog_rotation_test";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    const auto base = (dir / "app.log").string();
+
+    std::vector<std::string> closed;
+    std::mutex closedMtx;
+    {
+        QLog::RotationOptions options;
+        options.maxBytes = 200;
+        options.onSegmentClosed = [&](const std::string& path)
+        {
+            std::lock_guard<std::mutex> lock(closedMtx);
+            closed.push_back(path);
+        };
+        QLog::RotatingFileSink sink(base, options);
+        EXPECT_EQ(sink.CurrentPath(), base + ".1");
+
+        QLog::Logger logger{sink, QLog::Level::Info};
+        for (int i = 0; i < 40; ++i)
+        {
+            logger.Info("rotating record number %02d", i);
+        }
+    }
+
+    // Every record landed in exactly one segment, in order
+    std::string all;
+    size_t segments = 0;
+    for (std::uint64_t i = 1; fs::exists(base + "." + std::to_string(i)); ++i, ++segments)
+    {
+        std::ifstream in(base + "." + std::to_string(i));
+        std::stringstream ss;
+        ss << in.rdbuf();
+        all += ss.str();
+    }
+    EXPECT_GT(segments, 3u);
+    EXPECT_EQ(closed.size(), segments - 1);
+    size_t last = 0;
+    for (int i = 0; i < 40; ++i)
+    {
+        char expected[64];
+        std::snprintf(expected, sizeof(expected), "INFO: rotating record number %02d\n", i);
+        const auto pos = all.find(expected);
+        ASSERT_NE(pos, std::string::npos) << expected;
+        EXPECT_GE(pos, last);
+        last = pos;
+    }
+    fs::remove_all(dir);
+}
+
+TEST(QLog, RotatingFileSinkSurvivesSlowHousekeeper)
+{
+    namespace fs = std::filesystem;
+    const auto dir = fs::temp_directory_path() / "qlog_rotation_slow_test";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    const auto base = (dir / "app.log").string();
+
+    constexpr int kRecords = 60;
+    std::vector<std::string> closed;
+    std::mutex closedMtx;
+    std::string current;
+    {
+        // Every record rotates, while the housekeeper mostly sleeps in the callback,
+        // so Rotate() keeps opening segments itself under the pre-open pass
+        QLog::RotationOptions options;
+        options.maxBytes = 16;
+        options.onSegmentClosed = [&](const std::string& path)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(3));
+            std::lock_guard<std::mutex> lock(closedMtx);
+            closed.push_back(path);
+        };
+        QLog::RotatingFileSink sink(base, options);
+        QLog::Logger logger{sink, QLog::Level::Info};
+        for (int i = 0; i < kRecords; ++i)
+        {
+            logger.Info("slow housekeeper record %02d", i);
+            if (i % 4 == 0)
+            {
+                logger.Flush();
+            }
+        }
+        logger.Shutdown();
+        current = sink.CurrentPath();
+    }
+
+    // Each finished segment was handed over once, and never the live one
+    std::vector<std::string> sorted = closed;
+    std::sort(sorted.begin(), sorted.end());
+    EXPECT_EQ(std::adjacent_find(sorted.begin(), sorted.end()), sorted.end());
+    EXPECT_EQ(std::find(closed.begin(), closed.end(), current), closed.end());
+    // ... oldest first, even when the housekeeper fell behind
+    std::uint64_t previous = 0;
+    for (const auto& path : closed)
+    {
+        const std::uint64_t index = std::stoull(path.substr(path.rfind('.') + 1));
+        EXPECT_GT(index, previous) << path;
+        previous = index;
+    }
+
+    size_t segments = 0;
+    for (std::uint64_t i = 1; fs::exists(base + "." + std::to_string(i)); ++i)
+    {
+        std::ifstream in(base + "." + std::to_string(i));
+        std::string line;
+        ASSERT_TRUE(std::getline(in, line)) << "empty segment " << i;
+        char expected[64];
+        std::snprintf(expected, sizeof(expected), "INFO: slow housekeeper record %02d", static_cast<int>(i - 1));
+        EXPECT_NE(line.find(expected), std::string::npos) << line;
+        EXPECT_FALSE(std::getline(in, line)) << "segment " << i << " has a second record";
+        ++segments;
+    }
+    EXPECT_EQ(segments, static_cast<size_t>(kRecords));
+    EXPECT_EQ(closed.size(), segments - 1);
+    EXPECT_EQ(current, base + "." + std::to_string(kRecords));
+    fs::remove_all(dir);
+}
+
+TEST(QLog, RotatingFileSinkRotatesByIntervalAndCompresses)
+{
+    namespace fs = std::filesystem;
+    const auto dir = fs::temp_directory_path() / "qlog_rotation_interval_test";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    const auto base = (dir / "app.log").string();
+    {
+        QLog::RotationOptions options;
+        options.interval = std::chrono::seconds(1);
+        options.compression = QLog::Compression::Gzip;
+        QLog::RotatingFileSink sink(base, options);
+        QLog::Logger logger{sink, QLog::Level::Info};
+        logger.Info("before the boundary");
+        logger.Flush();
+        // Past the next whole second, whatever the current sub-second offset
+        std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+        logger.Info("after the boundary");
+        logger.Flush();
+        EXPECT_EQ(sink.CurrentPath(), base + ".2");
+    }
+
+    auto readAll = [](const std::string& path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        std::stringstream ss;
+        ss << in.rdbuf();
+        return ss.str();
+    };
+    EXPECT_NE(readAll(base + ".2").find("INFO: after the boundary\n"), std::string::npos);
+#if defined(QLOG_HAVE_ZLIB)
+    // The finished segment was replaced by its compressed copy
+    EXPECT_FALSE(fs::exists(base + ".1"));
+    gzFile in = gzopen((base + ".1.gz").c_str(), "rb");
+    ASSERT_NE(in, nullptr);
+    char text[256];
+    const int n = gzread(in, text, sizeof(text));
+    gzclose(in);
+    ASSERT_GT(n, 0);
+    EXPECT_NE(std::string(text, static_cast<size_t>(n)).find("INFO: before the boundary\n"), std::string::npos);
+#else
+    EXPECT_NE(readAll(base + ".1").find("INFO: before the boundary\n"), std::string::npos);
+#endif
+    fs::remove_all(dir);
+}
+
+TEST(QLog, MappedRingFileSinkKeepsNewestRecords)
+{
+    const auto path = (std::filesystem::temp_directory_path() / "qlog_ring_test.bin").string();
+    std::filesystem::remove(path);
+    {
+        QLog::MappedRingFileSink sink(path, 4096);
+        QLog::Logger logger{sink, QLog::Level::Info};
+        logger.EnableTimestamps(false);
+        for (int i = 0; i < 500; ++i)
+        {
+            logger.Info("ring record %03d", i);
+        }
+    }
+
+    std::string text;
+    ASSERT_TRUE(QLog::ReadRingFile(path, text));
+    EXPECT_LE(text.size(), 4096u);
+    EXPECT_EQ(text.find("ring record 000"), std::string::npos); // overwritten
+    EXPECT_EQ(text.rfind("INFO: ring record 499\n"), text.size() - 22);
+    EXPECT_EQ(text.compare(0, 6, "INFO: "), 0); // starts at a record boundary
+
+    // Reopening continues after the previous cursor
+    {
+        QLog::MappedRingFileSink sink(path, 4096);
+        QLog::Logger logger{sink, QLog::Level::Info};
+        logger.EnableTimestamps(false);
+        logger.Info("after reopen");
+    }
+    ASSERT_TRUE(QLog::ReadRingFile(path, text));
+    EXPECT_LT(text.find("ring record 499"), text.find("after reopen"));
+    std::filesystem::remove(path);
+}
+
+TEST(QLog, NullSinkTakesEverything)
+{
+    QLog::NullSink sink;
+    QLog::Logger logger{sink, QLog::Level::Trace};
+    for (int i = 0; i < 1000; ++i)
+    {
+        logger.Info("n%d", i);
+        logger.LogDeferred(QLog::Level::Debug, "d%d %s", i, "deferred");
+    }
+    logger.Flush();
+    EXPECT_EQ(logger.GetStats().written, 2000u);
+}
+
+TEST(QLog, MemoryRingSinkKeepsNewestRecords)
+{
+    QLog::MemoryRingSink ring(4, 64);
+    {
+        QLog::Logger logger{ring, QLog::Level::Trace};
+        logger.EnableTimestamps(false);
+        for (int i = 0; i < 10; ++i)
+        {
+            logger.Info("r%d", i);
+        }
+        logger.Warn("%s", std::string(200, 'x').c_str()); // longer than a slot
+        logger.Flush();
+    }
+    EXPECT_EQ(ring.Written(), 11u);
+    EXPECT_EQ(ring.Size(), 4u);
+    const auto lines = ring.Lines();
+    ASSERT_EQ(lines.size(), 4u);
+    EXPECT_EQ(lines[0], "INFO: r7");
+    EXPECT_EQ(lines[2], "INFO: r9");
+    EXPECT_EQ(lines[3].rfind("WARN: xxxx", 0), 0u);
+    EXPECT_LT(lines[3].size(), 64u);
+    const std::string text = ring.Text();
+    EXPECT_EQ(text.rfind("INFO: r7\nINFO: r8\nINFO: r9\nWARN: x", 0), 0u);
+    EXPECT_EQ(text.back(), '\n');
+
+#if !defined(_WIN32)
+    // The crash-handler path produces the same bytes
+    int fds[2];
+    ASSERT_EQ(::pipe(fds), 0);
+    EXPECT_EQ(ring.DumpTo(fds[1]), text.size());
+    ::close(fds[1]);
+    std::string dumped(text.size() + 1, '\0');
+    dumped.resize(static_cast<size_t>(::read(fds[0], dumped.data(), dumped.size())));
+    ::close(fds[0]);
+    EXPECT_EQ(dumped, text);
+#endif
+
+    ring.Clear();
+    EXPECT_EQ(ring.Size(), 0u);
+    EXPECT_TRUE(ring.Text().empty());
+    EXPECT_THROW(QLog::MemoryRingSink(0), std::invalid_argument);
+}
+
+TEST(QLog, TimestampFormatterMatchesLocaltime)
+{
+    using namespace std::chrono;
+
+    QLog::TimestampFormatter formatter;
+    char cached[32];
+    // Walk ~3 years in irregular steps so DST changes and year ends are crossed,
+    // plus sub-second steps that only patch the microseconds
+    std::int64_t t = 1700000000;
+    for (int i = 0; i < 5000; ++i, t += 19421 + (i % 7) * 3)
+    {
+        for (int us : {0, 999999, 123})
+        {
+            const auto tp = system_clock::time_point{seconds{t} + microseconds{us}};
+            formatter.Format(tp, cached);
+
+            std::time_t tt = static_cast<std::time_t>(t);
+            std::tm tm{};
+#if defined(_WIN32)
+            localtime_s(&tm, &tt);
+#else
+            localtime_r(&tt, &tm);
+#endif
+            char expected[64];
+            std::snprintf(expected, sizeof(expected), "[%04d-%02d-%02d %02d:%02d:%02d.%06d] ",
+                          tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, us);
+            ASSERT_STREQ(cached, expected) << "t=" << t;
+        }
+    }
+}
+
+TEST(QLog, TickClockSourcesResolveToWallTime)
+{
+    struct StampSink : QLog::Sink
+    {
+        void Write(const QLog::Message& message) override
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stamps.push_back(message.timestamp);
+            lines.push_back(QLog::FormatTimestamp(message));
+        }
+        std::mutex mtx;
+        std::vector<std::optional<std::chrono::system_clock::time_point>> stamps;
+        std::vector<std::string> lines;
+    };
+
+    for (auto clock : {QLog::ClockSource::Steady, QLog::ClockSource::Tsc})
+    {
+        StampSink sink;
+        const auto before = std::chrono::system_clock::now();
+        {
+            QLog::LoggerOptions options;
+            options.clock = clock;
+            QLog::Logger logger{sink, options};
+            EXPECT_EQ(logger.GetClockSource(), clock);
+            logger.Info("one");
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            logger.Info("two");
+        }
+        const auto after = std::chrono::system_clock::now();
+
+        std::lock_guard<std::mutex> lock(sink.mtx);
+        ASSERT_EQ(sink.stamps.size(), 2u);
+        for (const auto& ts : sink.stamps)
+        {
+            ASSERT_TRUE(ts.has_value());
+            EXPECT_GE(*ts, before - std::chrono::milliseconds(5));
+            EXPECT_LE(*ts, after + std::chrono::milliseconds(5));
+        }
+        EXPECT_GE(*sink.stamps[1] - *sink.stamps[0], std::chrono::milliseconds(4));
+        EXPECT_EQ(sink.lines[0].size(), 29u);
+    }
+}
+
+TEST(QLog, PackedRecordsSurviveEveryQueueMode)
+{
+    for (auto mode : {QLog::QueueMode::Locked, QLog::QueueMode::LockFree, QLog::QueueMode::PerThread})
+    {
+        std::ostringstream oss;
+        QLog::OStreamSink sink(oss);
+        {
+            QLog::LoggerOptions options;
+            options.queueMode = mode;
+            QLog::Logger logger{sink, options};
+            // Around the pool block boundary, deferred and plain records interleaved
+            for (size_t len : {0, 1, 494, 495, 496, 3000})
+            {
+                const std::string text(len, 'a' + static_cast<char>(len % 26));
+                logger.Info("%s", text.c_str());
+                logger.LogDeferred(QLog::Level::Info, "deferred %zu %s", len, text);
+            }
+            logger.EnableTimestamps(false);
+            logger.Warn("untimed");
+        }
+
+        const auto s = oss.str();
+        for (size_t len : {0, 1, 494, 495, 496, 3000})
+        {
+            const std::string text(len, 'a' + static_cast<char>(len % 26));
+            EXPECT_NE(s.find("] INFO: " + text + "\n"), std::string::npos) << len;
+            EXPECT_NE(s.find("] INFO: deferred " + std::to_string(len) + " " + text + "\n"), std::string::npos) << len;
+        }
+        EXPECT_NE(s.find("\nWARN: untimed\n"), std::string::npos);
+    }
+}
+
+TEST(QLog, SmallArenaWrapsAndFallsBackToHeap)
+{
+    std::ostringstream oss;
+    QLog::OStreamSink sink(oss);
+    QLog::LoggerOptions options;
+    options.arenaSize = 2048; // a few records: forces wrap-around, fillers and heap fallback
+
+    constexpr int kThreads = 4;
+    constexpr int kPerThread = 2000;
+    {
+        QLog::Logger logger{sink, options};
+        std::vector<std::thread> threads;
+        for (int t = 0; t < kThreads; ++t)
+        {
+            threads.emplace_back([t, &logger]
+            {
+                for (int n = 0; n < kPerThread; ++n)
+                {
+                    if (n % 3 == 0)
+                    {
+                        logger.LogDeferred(QLog::Level::Info, "t%d n%d %s", t, n, "deferred");
+                    }
+                    else
+                    {
+                        logger.Info("t%d n%d %.*s", t, n, n % 200, std::string(200, 'p').c_str());
+                    }
+                }
+            });
+        }
+        for (auto& th : threads)
+        {
+            th.join();
+        }
+    }
+
+    std::istringstream lines(oss.str());
+    std::string line;
+    std::vector<int> next(kThreads, 0);
+    while (std::getline(lines, line))
+    {
+        int t = -1;
+        int n = -1;
+        const auto body = line.find("INFO: t");
+        ASSERT_NE(body, std::string::npos) << line;
+        ASSERT_EQ(std::sscanf(line.c_str() + body, "INFO: t%d n%d", &t, &n), 2) << line;
+        ASSERT_TRUE(t >= 0 && t < kThreads);
+        EXPECT_EQ(n, next[t]++) << "records of one thread stay in order";
+        const std::string tail = n % 3 == 0 ? " deferred" : " " + std::string(static_cast<size_t>(n % 200), 'p');
+        EXPECT_EQ(line.substr(line.size() - tail.size()), tail) << line;
+    }
+    for (int t = 0; t < kThreads; ++t)
+    {
+        EXPECT_EQ(next[t], kPerThread);
+    }
+}
+
+namespace
+{
+    // Per-record payload, so a chunk handed to two producers shows up as a garbled line
+    std::string ArenaPayload(int t, int n)
+    {
+        return std::string(static_cast<size_t>(1 + (n * 7 + t) % 120), static_cast<char>('a' + (t * 31 + n) % 26));
+    }
+}
+
+TEST(QLog, ArenaNeverHandsOutAChunkTwice)
+{
+    for (auto mode : {QLog::QueueMode::Locked, QLog::QueueMode::LockFree, QLog::QueueMode::PerThread})
+    {
+        std::ostringstream oss;
+        QLog::OStreamSink sink(oss);
+        QLog::LoggerOptions options;
+        options.queueMode = mode;
+        options.arenaSize = 4096; // producers keep racing for the same few chunks
+        options.backpressure = QLog::Backpressure::Block; // every record must arrive
+
+        constexpr int kThreads = 4;
+        constexpr int kPerThread = 3000;
+        QLog::LoggerStats stats;
+        {
+            QLog::Logger logger{sink, options};
+            logger.EnableTimestamps(false);
+            std::vector<std::thread> threads;
+            for (int t = 0; t < kThreads; ++t)
+            {
+                threads.emplace_back([t, &logger]
+                {
+                    for (int n = 0; n < kPerThread; ++n)
+                    {
+                        logger.Info("t%d n%d %s", t, n, ArenaPayload(t, n).c_str());
+                    }
+                });
+            }
+            for (auto& th : threads)
+            {
+                th.join();
+            }
+            logger.Flush();
+            stats = logger.GetStats();
+        }
+        EXPECT_GT(stats.arenaAllocations, 0u);
+
+        std::istringstream lines(oss.str());
+        std::string line;
+        std::vector<int> next(kThreads, 0);
+        while (std::getline(lines, line))
+        {
+            int t = -1;
+            int n = -1;
+            ASSERT_EQ(std::sscanf(line.c_str(), "INFO: t%d n%d", &t, &n), 2) << line;
+            ASSERT_TRUE(t >= 0 && t < kThreads) << line;
+            ASSERT_EQ(line, "INFO: t" + std::to_string(t) + " n" + std::to_string(n) + " " + ArenaPayload(t, n));
+            EXPECT_EQ(n, next[t]++);
+        }
+        for (int t = 0; t < kThreads; ++t)
+        {
+            EXPECT_EQ(next[t], kPerThread);
+        }
+    }
+}
+
+TEST(QLog, ExhaustedArenaFallsBackToHeapAndRecovers)
+{
+    std::ostringstream oss;
+    GatedSink sink(oss);
+    QLog::LoggerOptions options;
+    options.arenaSize = 2048;
+    QLog::Logger logger{sink, options};
+    logger.EnableTimestamps(false);
+
+    // The parked worker holds every record, so the arena fills up
+    logger.Info("first");
+    sink.WaitUntilEntered();
+    constexpr int kThreads = 4;
+    constexpr int kPerThread = 50;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t)
+    {
+        threads.emplace_back([t, &logger]
+        {
+            for (int n = 0; n < kPerThread; ++n)
+            {
+                logger.Info("t%d n%d %s", t, n, ArenaPayload(t, n).c_str());
+            }
+        });
+    }
+    for (auto& th : threads)
+    {
+        th.join();
+    }
+    const auto full = logger.GetStats();
+    EXPECT_GT(full.arenaAllocations, 0u);
+    EXPECT_GT(full.heapAllocations, 0u);
+    EXPECT_EQ(full.arenaAllocations + full.heapAllocations, 1u + kThreads * kPerThread);
+
+    // Once written, the space is reused
+    sink.Open();
+    logger.Flush();
+    logger.Info("after");
+    logger.Flush();
+    const auto drained = logger.GetStats();
+    EXPECT_EQ(drained.arenaAllocations, full.arenaAllocations + 1);
+    EXPECT_EQ(drained.heapAllocations, full.heapAllocations);
+
+    std::istringstream lines(oss.str());
+    std::string line;
+    size_t count = 0;
+    while (std::getline(lines, line))
+    {
+        int t = -1;
+        int n = -1;
+        if (std::sscanf(line.c_str(), "INFO: t%d n%d", &t, &n) == 2)
+        {
+            ASSERT_EQ(line, "INFO: t" + std::to_string(t) + " n" + std::to_string(n) + " " + ArenaPayload(t, n));
+            ++count;
+        }
+    }
+    EXPECT_EQ(count, static_cast<size_t>(kThreads * kPerThread));
+    EXPECT_NE(oss.str().find("INFO: first\n"), std::string::npos);
+    EXPECT_NE(oss.str().find("INFO: after\n"), std::string::npos);
+}
+
+TEST(QLog, BackpressureDropPoliciesCountDrops)
+{
+    for (auto mode : {QLog::QueueMode::Locked, QLog::QueueMode::LockFree})
+    {
+        for (auto policy : {QLog::Backpressure::DropNewest, QLog::Backpressure::DropOldest})
+        {
+            std::ostringstream oss;
+            GatedSink sink(oss);
+            QLog::LoggerOptions options;
+            options.capacity = 3;
+            options.queueMode = mode;
+            options.backpressure = policy;
+            QLog::Logger logger{sink, options};
+
+            logger.Info("first");
+            sink.WaitUntilEntered();
+            for (const char* text : {"a", "b", "c", "d", "e"})
+            {
+                logger.Info("%s", text);
+            }
+            const auto stats = logger.GetBackpressureStats();
+            sink.Open();
+            logger.Shutdown();
+
+            const auto s = oss.str();
+            if (policy == QLog::Backpressure::DropNewest)
+            {
+                EXPECT_EQ(stats.droppedNewest, 2u);
+                EXPECT_EQ(stats.droppedOldest, 0u);
+                EXPECT_NE(s.find("] INFO: c\n"), std::string::npos);
+                EXPECT_EQ(s.find("] INFO: d\n"), std::string::npos);
+            }
+            else
+            {
+                EXPECT_EQ(stats.droppedOldest, 2u);
+                EXPECT_EQ(stats.droppedNewest, 0u);
+                EXPECT_EQ(s.find("] INFO: b\n"), std::string::npos);
+                EXPECT_NE(s.find("] INFO: e\n"), std::string::npos);
+            }
+        }
+    }
+}
+
+TEST(QLog, LoggerStatsCountEveryRecord)
+{
+    std::ostringstream oss;
+    GatedSink sink(oss);
+    QLog::LoggerOptions options;
+    options.capacity = 3;
+    options.queueMode = QLog::QueueMode::LockFree;
+    QLog::Logger logger{sink, options};
+
+    logger.Info("first");
+    sink.WaitUntilEntered();
+    for (const char* text : {"a", "b", "c", "d"})
+    {
+        logger.Info("%s", text);
+    }
+    const std::string big(QLog::kDefaultArenaSize + 1, 'x'); // cannot fit the arena
+    logger.Info("%s", big.c_str());
+    sink.Open();
+    logger.Flush();
+
+    const auto stats = logger.GetStats();
+    EXPECT_EQ(stats.enqueued, 6u);
+    EXPECT_EQ(stats.dropped, 2u);
+    EXPECT_EQ(stats.backpressure.droppedOldest, 2u);
+    EXPECT_EQ(stats.written, 4u);
+    EXPECT_EQ(stats.peakQueueDepth, 3u);
+    EXPECT_EQ(stats.arenaAllocations, 5u);
+    EXPECT_EQ(stats.heapAllocations, 1u);
+    // The first record of the first batch is always sampled
+    ASSERT_GE(stats.latency.samples, 1u);
+    std::uint64_t bucketed = 0;
+    for (auto n : stats.latency.buckets)
+    {
+        bucketed += n;
+    }
+    EXPECT_EQ(bucketed, stats.latency.samples);
+    EXPECT_GE(stats.latency.Percentile(1.0), 1u);
+    EXPECT_LE(stats.latency.Percentile(0.0), stats.latency.Percentile(1.0));
+}
+
+TEST(QLog, PeriodicStatsCallback)
+{
+    QLog::LogBackend backend(1);
+    for (QLog::LogBackend* shared : {static_cast<QLog::LogBackend*>(nullptr), &backend})
+    {
+        std::ostringstream oss;
+        QLog::OStreamSink sink(oss);
+        std::mutex mtx;
+        std::vector<QLog::LoggerStats> reports;
+        QLog::LoggerOptions options;
+        options.backend = shared;
+        options.statsInterval = std::chrono::milliseconds(5);
+        options.onStats = [&](const QLog::LoggerStats& stats)
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            reports.push_back(stats);
+        };
+        QLog::Logger logger{sink, options};
+        for (int i = 0; i < 100; ++i)
+        {
+            logger.Info("n%d", i);
+        }
+        logger.Flush();
+
+        // An idle worker still wakes up to report
+        const auto until = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        size_t seen = 0;
+        while (std::chrono::steady_clock::now() < until)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                seen = reports.size();
+                if (seen >= 2 && reports.back().written == 100)
+                {
+                    break;
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        EXPECT_GE(seen, 2u);
+        logger.Shutdown();
+        std::lock_guard<std::mutex> lock(mtx);
+        ASSERT_FALSE(reports.empty());
+        EXPECT_EQ(reports.back().enqueued, 100u);
+        EXPECT_EQ(reports.back().written, 100u);
+        EXPECT_EQ(reports.back().dropped, 0u);
+    }
+}
+
+TEST(QLog, BackpressureBlockLosesNothing)
+{
+    for (auto mode : {QLog::QueueMode::Locked, QLog::QueueMode::LockFree, QLog::QueueMode::PerThread})
+    {
+        for (auto policy : {QLog::Backpressure::Block, QLog::Backpressure::SpinThenBlock})
+        {
+            std::ostringstream oss;
+            GatedSink sink(oss);
+            QLog::LoggerOptions options;
+            options.capacity = 2;
+            options.queueMode = mode;
+            options.backpressure = policy;
+            QLog::Logger logger{sink, options};
+
+            logger.Info("first");
+            sink.WaitUntilEntered();
+            std::thread producer([&]
+            {
+                for (int n = 0; n < 50; ++n)
+                {
+                    logger.Info("n%d", n);
+                }
+            });
+            // The producer fills the queue and then has to wait for the gated worker
+            while (logger.GetBackpressureStats().blocked == 0)
+            {
+                std::this_thread::yield();
+            }
+            sink.Open();
+            producer.join();
+            logger.Shutdown();
+
+            const auto stats = logger.GetBackpressureStats();
+            EXPECT_EQ(stats.droppedNewest + stats.droppedOldest, 0u);
+            const auto s = oss.str();
+            for (int n = 0; n < 50; ++n)
+            {
+                EXPECT_NE(s.find("] INFO: n" + std::to_string(n) + "\n"), std::string::npos) << n;
+            }
+        }
+    }
+}
+
+TEST(QLog, FlushWaitsForDelivery)
+{
+    for (auto mode : {QLog::QueueMode::Locked, QLog::QueueMode::LockFree, QLog::QueueMode::PerThread})
+    {
+        struct CountingSink : QLog::Sink
+        {
+            void Write(const QLog::Message&) override
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(50)); // slower than the producers
+                ++written;
+            }
+            void Flush() override { flushedAt = written.load(); }
+            std::atomic<int> written{0};
+            std::atomic<int> flushedAt{-1};
+        } sink;
+
+        QLog::LoggerOptions options;
+        options.queueMode = mode;
+        options.capacity = 1024;
+        options.backpressure = QLog::Backpressure::Block;
+        QLog::Logger logger{sink, options};
+        std::thread other([&]
+        {
+            for (int n = 0; n < 100; ++n)
+            {
+                logger.Info("other %d", n);
+            }
+        });
+        other.join();
+        for (int n = 0; n < 100; ++n)
+        {
+            logger.Info("main %d", n);
+        }
+        logger.Flush();
+        EXPECT_GE(sink.written.load(), 200);
+        EXPECT_GE(sink.flushedAt.load(), 200);
+    }
+}
+
+TEST(QLog, AutoFlushByThreshold)
+{
+    struct FlushCountingSink : QLog::Sink
+    {
+        void Write(const QLog::Message&) override {}
+        void Flush() override { ++flushes; }
+        std::atomic<int> flushes{0};
+    } sink;
+
+    QLog::LoggerOptions options;
+    options.flushThreshold = 1;
+    {
+        QLog::Logger logger{sink, options};
+        logger.Info("one");
+        for (int i = 0; i < 1000 && sink.flushes.load() == 0; ++i)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        EXPECT_GE(sink.flushes.load(), 1);
+    }
+
+    FlushCountingSink quiet;
+    options.flushThreshold = 0;
+    options.flushInterval = std::chrono::milliseconds(5);
+    QLog::Logger logger{quiet, options};
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_EQ(quiet.flushes.load(), 0) << "nothing written, nothing to flush";
+    logger.Info("one");
+    for (int i = 0; i < 1000 && quiet.flushes.load() == 0; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_GE(quiet.flushes.load(), 1);
+}
+
+TEST(QLog, WaitStrategiesDeliverEverything)
+{
+    for (auto strategy : {QLog::WaitStrategy::Park, QLog::WaitStrategy::SpinThenPark, QLog::WaitStrategy::BusySpin})
+    {
+        for (auto mode : {QLog::QueueMode::Locked, QLog::QueueMode::LockFree, QLog::QueueMode::PerThread})
+        {
+            std::ostringstream oss;
+            QLog::OStreamSink sink(oss);
+            QLog::LoggerOptions options;
+            options.queueMode = mode;
+            options.waitStrategy = strategy;
+            options.capacity = 1024;
+            options.backpressure = QLog::Backpressure::Block;
+            QLog::Logger logger{sink, options};
+
+            // Bursts separated by pauses, so the worker parks and must be woken again
+            for (int burst = 0; burst < 5; ++burst)
+            {
+                for (int n = 0; n < 20; ++n)
+                {
+                    logger.Info("b%d n%d", burst, n);
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            }
+            logger.Flush();
+
+            const auto s = oss.str();
+            EXPECT_EQ(std::count(s.begin(), s.end(), '\n'), 100);
+            EXPECT_NE(s.find("INFO: b4 n19\n"), std::string::npos);
+        }
+    }
+}
+
+TEST(QLog, ParkedWorkerNeverMissesRecords)
+{
+    // A producer stalled between publishing and signalling used to be able to
+    // leave the worker parked for good while the queue filled up
+    for (auto mode : {QLog::QueueMode::Locked, QLog::QueueMode::LockFree, QLog::QueueMode::PerThread})
+    {
+        std::ostringstream oss;
+        QLog::OStreamSink sink(oss);
+        QLog::LoggerOptions options;
+        options.capacity = 4096;
+        options.queueMode = mode;
+        options.backpressure = QLog::Backpressure::Block;
+        QLog::Logger logger{sink, options};
+        std::thread producer([&]
+        {
+            for (int n = 0; n < 100000; ++n)
+            {
+                logger.Info("n%d", n);
+            }
+        });
+        producer.join();
+        logger.Flush();
+        const auto s = oss.str();
+        EXPECT_EQ(std::count(s.begin(), s.end(), '\n'), 100000);
+    }
+}
+
+TEST(QLog, FanOutAppliesPerSinkLevels)
+{
+    std::ostringstream all;
+    std::ostringstream warnings;
+    std::ostringstream detached;
+    QLog::OStreamSink allSink(all);
+    QLog::OStreamSink warnSink(warnings);
+    QLog::OStreamSink detachedSink(detached);
+    {
+        QLog::Logger logger{allSink, QLog::Level::Debug};
+        logger.AddSink(warnSink, QLog::Level::Warn);
+        logger.AddSink(detachedSink, QLog::Level::Info, true);
+
+        logger.Debug("dbg");
+        logger.Info("info %d", 1);
+        logger.LogDeferred(QLog::Level::Error, "deferred %s", "err");
+        logger.Flush();
+
+        EXPECT_NE(all.str().find("] DEBUG: dbg\n"), std::string::npos);
+        EXPECT_NE(all.str().find("] ERROR: deferred err\n"), std::string::npos);
+        EXPECT_EQ(warnings.str().find("INFO"), std::string::npos);
+        EXPECT_NE(warnings.str().find("] ERROR: deferred err\n"), std::string::npos);
+        EXPECT_EQ(detached.str().find("DEBUG"), std::string::npos);
+        EXPECT_NE(detached.str().find("] INFO: info 1\n"), std::string::npos);
+        EXPECT_NE(detached.str().find("] ERROR: deferred err\n"), std::string::npos);
+    }
+}
+
+TEST(QLog, SlowDetachedSinkDoesNotHoldBackOthers)
+{
+    struct CountingSink : QLog::Sink
+    {
+        void Write(const QLog::Message&) override { ++count; }
+        std::atomic<int> count{0};
+    } fast;
+    std::ostringstream oss;
+    GatedSink slow(oss);
+
+    QLog::Logger logger{fast};
+    logger.AddSink(slow, QLog::Level::Trace, true);
+    logger.Info("first");
+    slow.WaitUntilEntered(); // the slow sink's thread is now stuck
+    for (int n = 0; n < 100; ++n)
+    {
+        logger.Info("n%d", n);
+    }
+    for (int i = 0; i < 2000 && fast.count.load() < 101; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_EQ(fast.count.load(), 101);
+
+    slow.Open();
+    logger.Flush();
+    EXPECT_NE(oss.str().find("] INFO: n99\n"), std::string::npos);
+}
+
+TEST(QLog, StalledDetachedSinkDoesNotPinTheArena)
+{
+    QLog::NullSink fast;
+    std::ostringstream oss;
+    GatedSink slow(oss);
+
+    QLog::LoggerOptions options;
+    options.arenaSize = 64 * 1024;
+    QLog::Logger logger{fast, options};
+    logger.AddSink(slow, QLog::Level::Trace, true);
+    logger.Info("first");
+    slow.WaitUntilEntered();
+
+    // Ten arenas' worth of records while the detached sink is stuck: it queues
+    // copies, so the arena keeps being reused instead of overflowing to the heap
+    constexpr int kRecords = 6000;
+    for (int n = 0; n < kRecords; ++n)
+    {
+        logger.Info("record %05d padded out to about a hundred bytes of text .....................", n);
+        // Flush() would wait for the stuck sink; pace on the worker instead
+        for (int i = 0; n % 100 == 99 && i < 2000 && logger.GetStats().written < n + 2u; ++i)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    }
+    const auto stats = logger.GetStats();
+    EXPECT_LT(stats.heapAllocations, kRecords / 20u);
+    logger.LogDeferred(QLog::Level::Warn, "deferred %s %d", std::string("copied"), 7); // rendered from the copy
+
+    slow.Open();
+    logger.Flush();
+    const auto s = oss.str();
+    EXPECT_EQ(std::count(s.begin(), s.end(), '\n'), kRecords + 2);
+    EXPECT_NE(s.find("record 05999 padded"), std::string::npos);
+    EXPECT_NE(s.find("] WARN: deferred copied 7\n"), std::string::npos);
+}
+
+TEST(QLog, ShardedLoggerKeepsEachThreadOnOneShard)
+{
+    std::ostringstream out[3];
+    QLog::OStreamSink sink0(out[0]);
+    QLog::OStreamSink sink1(out[1]);
+    QLog::OStreamSink sink2(out[2]);
+    QLog::ShardedLogger logger({&sink0, &sink1, &sink2});
+    ASSERT_EQ(logger.ShardCount(), 3u);
+
+    constexpr int kThreads = 6;
+    constexpr int kPerThread = 200;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t)
+    {
+        threads.emplace_back([&logger, t]
+        {
+            for (int i = 0; i < kPerThread; ++i)
+            {
+                logger.Info("t%d %d", t, i);
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    logger.Flush();
+
+    int total = 0;
+    for (int t = 0; t < kThreads; ++t)
+    {
+        const std::string first = "] INFO: t" + std::to_string(t) + " 0\n";
+        int owners = 0;
+        for (const auto& shard : out)
+        {
+            const auto s = shard.str();
+            if (s.find(first) == std::string::npos)
+            {
+                continue;
+            }
+            ++owners;
+            // A thread's records stay in order within its shard
+            size_t last = 0;
+            for (int i = 0; i < kPerThread; ++i)
+            {
+                const auto pos = s.find("] INFO: t" + std::to_string(t) + " " + std::to_string(i) + "\n");
+                ASSERT_NE(pos, std::string::npos);
+                EXPECT_GE(pos, last);
+                last = pos;
+                ++total;
+            }
+        }
+        EXPECT_EQ(owners, 1);
+    }
+    EXPECT_EQ(total, kThreads * kPerThread);
+    EXPECT_THROW(QLog::ShardedLogger({}), std::invalid_argument);
+}
+
+TEST(QLog, ShardedLoggerFiltersByItsLevel)
+{
+    std::ostringstream out;
+    QLog::OStreamSink sink(out);
+    QLog::LoggerOptions options;
+    options.level = QLog::Level::Warn;
+    QLog::ShardedLogger logger({&sink}, options);
+
+    EXPECT_FALSE(logger.IsEnabled(QLog::Level::Info));
+    EXPECT_TRUE(logger.IsEnabled(QLog::Level::Warn));
+    logger.Info("hidden %d", 1);
+    logger.Log(QLog::Level::Debug, "hidden %d", 2);
+    logger.LogDeferred(QLog::Level::Trace, "hidden %d", 3);
+    logger.Error("shown %d", 1);
+    logger.SetLevel(QLog::Level::Debug);
+    EXPECT_TRUE(logger.IsEnabled(QLog::Level::Debug));
+    logger.Debug("shown %d", 2);
+    logger.Flush();
+
+    const auto s = out.str();
+    EXPECT_EQ(s.find("hidden"), std::string::npos);
+    EXPECT_NE(s.find("] ERROR: shown 1\n"), std::string::npos);
+    EXPECT_NE(s.find("] DEBUG: shown 2\n"), std::string::npos);
+}
+
+TEST(QLog, MergeLogFilesOrdersByTimestamp)
+{
+    const auto dir = std::filesystem::temp_directory_path();
+    const auto a = (dir / "qlog_merge_a.log").string();
+    const auto b = (dir / "qlog_merge_b.log").string();
+    std::ofstream(a) << "[2025-01-01 00:00:01.000000] INFO: a1\n"
+                        "  continued\n"
+                        "[2025-01-01 00:00:03.000000] INFO: a3\n";
+    std::ofstream(b) << "[2025-01-01 00:00:00.500000] INFO: b0\n"
+                        "[2025-01-01 00:00:02.000000] INFO: b2\n"
+                        "[2025-01-01 00:00:03.000000] INFO: b3\n";
+
+    std::ostringstream merged;
+    ASSERT_TRUE(QLog::MergeLogFiles({a, b}, merged));
+    EXPECT_EQ(merged.str(), "[2025-01-01 00:00:00.500000] INFO: b0\n"
+                            "[2025-01-01 00:00:01.000000] INFO: a1\n"
+                            "  continued\n"
+                            "[2025-01-01 00:00:02.000000] INFO: b2\n"
+                            "[2025-01-01 00:00:03.000000] INFO: a3\n"
+                            "[2025-01-01 00:00:03.000000] INFO: b3\n");
+    EXPECT_FALSE(QLog::MergeLogFiles({(dir / "qlog_merge_missing.log").string()}, merged));
+    std::filesystem::remove(a);
+    std::filesystem::remove(b);
+}
+
+TEST(QLog, SharedBackendServesManyLoggers)
+{
+    constexpr int kLoggers = 20;
+    constexpr int kPerLogger = 300;
+    std::vector<std::ostringstream> outs(kLoggers);
+    std::vector<std::unique_ptr<QLog::OStreamSink>> sinks;
+    QLog::LogBackend backend(2);
+    {
+        std::vector<std::unique_ptr<QLog::Logger>> loggers;
+        for (int i = 0; i < kLoggers; ++i)
+        {
+            sinks.push_back(std::make_unique<QLog::OStreamSink>(outs[i]));
+            QLog::LoggerOptions options;
+            options.level = QLog::Level::Debug;
+            options.queueMode = i % 3 == 0 ? QLog::QueueMode::Locked
+                              : i % 3 == 1 ? QLog::QueueMode::LockFree : QLog::QueueMode::PerThread;
+            options.backend = &backend;
+            loggers.push_back(std::make_unique<QLog::Logger>(*sinks.back(), options));
+        }
+        EXPECT_EQ(backend.LoggerCount(), static_cast<size_t>(kLoggers));
+        loggers[1]->SetLevel(QLog::Level::Error); // levels stay per Logger
+
+        std::vector<std::thread> producers;
+        for (int t = 0; t < 4; ++t)
+        {
+            producers.emplace_back([&loggers, t]
+            {
+                for (int i = 0; i < kPerLogger; ++i)
+                {
+                    loggers[(t * kPerLogger + i) % kLoggers]->Info("m%d", t * kPerLogger + i);
+                }
+            });
+        }
+        for (auto& producer : producers)
+        {
+            producer.join();
+        }
+        loggers[0]->Flush();
+        const auto flushed = outs[0].str();
+        EXPECT_EQ(std::count(flushed.begin(), flushed.end(), '\n'), 4 * kPerLogger / kLoggers);
+
+        // Records still queued at destruction are drained by Shutdown()
+        loggers[2]->Warn("last words");
+    }
+    EXPECT_EQ(backend.LoggerCount(), 0u);
+    EXPECT_EQ(backend.ThreadCount(), 2u);
+
+    size_t total = 0;
+    for (int i = 0; i < kLoggers; ++i)
+    {
+        const auto s = outs[i].str();
+        total += static_cast<size_t>(std::count(s.begin(), s.end(), '\n'));
+    }
+    EXPECT_EQ(outs[1].str(), "");
+    EXPECT_EQ(total, 4 * kPerLogger - 4 * kPerLogger / kLoggers + 1);
+    EXPECT_NE(outs[2].str().find("] WARN: last words\n"), std::string::npos);
+}
+
+TEST(QLog, SharedBackendAutoFlushes)
+{
+    struct FlushCountingSink : QLog::Sink
+    {
+        void Write(const QLog::Message&) override {}
+        void Flush() override { ++flushes; }
+        std::atomic<int> flushes{0};
+    } sink;
+    QLog::LogBackend backend;
+    QLog::LoggerOptions options;
+    options.flushInterval = std::chrono::milliseconds(5);
+    options.backend = &backend;
+    QLog::Logger logger{sink, options};
+
+    logger.Info("pending");
+    for (int i = 0; i < 2000 && sink.flushes.load() == 0; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_GE(sink.flushes.load(), 1);
+}
+
+TEST(QLog, LazyStartWaitsForFirstKeptRecord)
+{
+    QLog::LogBackend backend;
+    std::ostringstream out;
+    QLog::OStreamSink sink(out);
+    QLog::LoggerOptions options;
+    options.lazyStart = true;
+    options.backend = &backend;
+    std::ostringstream warnOut;
+    QLog::OStreamSink warnSink(warnOut);
+    {
+        QLog::Logger logger{sink, options};
+        logger.AddSink(warnSink, QLog::Level::Warn); // before the constructor's sink exists
+        logger.Debug("filtered");
+        logger.Flush();
+        EXPECT_EQ(backend.LoggerCount(), 0u); // not started by a filtered record
+        EXPECT_EQ(logger.GetStats().enqueued, 0u);
+
+        logger.Info("first");
+        logger.Warn("second");
+        EXPECT_EQ(backend.LoggerCount(), 1u);
+        logger.Flush();
+        EXPECT_NE(out.str().find("] INFO: first\n"), std::string::npos);
+        EXPECT_NE(out.str().find("] WARN: second\n"), std::string::npos);
+        EXPECT_EQ(warnOut.str().find("first"), std::string::npos);
+        EXPECT_NE(warnOut.str().find("] WARN: second\n"), std::string::npos);
+        EXPECT_EQ(logger.GetStats().enqueued, 2u);
+
+        QLog::Logger unused{sink, options}; // never started, so never registered
+    }
+    EXPECT_EQ(backend.LoggerCount(), 0u);
+
+    for (auto mode : {QLog::QueueMode::Locked, QLog::QueueMode::LockFree, QLog::QueueMode::PerThread})
+    {
+        std::ostringstream modeOut;
+        QLog::OStreamSink modeSink(modeOut);
+        QLog::LoggerOptions lazy;
+        lazy.queueMode = mode;
+        lazy.lazyStart = true;
+        {
+            QLog::Logger logger{modeSink, lazy};
+            logger.Warn("w%d", 1);
+            logger.LogDeferred(QLog::Level::Error, "e%d", 2);
+        }
+        EXPECT_NE(modeOut.str().find("] WARN: w1\n"), std::string::npos);
+        EXPECT_NE(modeOut.str().find("] ERROR: e2\n"), std::string::npos);
+
+        // Records after a Shutdown that came first are dropped, not queued
+        QLog::Logger stopped{modeSink, lazy};
+        stopped.Shutdown();
+        stopped.Error("late");
+        stopped.Flush();
+        EXPECT_EQ(modeOut.str().find("late"), std::string::npos);
+    }
+}
+
+TEST(QLog, LazyStartRacingShutdownNeverStrandsFlush)
+{
+    // A first record that starts the Logger just after Shutdown() cleared
+    // m_running sets up storage but no worker; Flush() must not wait for one
+    QLog::NullSink sink;
+    QLog::LoggerOptions options;
+    options.lazyStart = true;
+    for (int i = 0; i < 200; ++i)
+    {
+        QLog::Logger logger{sink, options};
+        std::thread producer([&] { logger.Error("race %d", i); });
+        logger.Shutdown();
+        producer.join();
+        logger.Flush();
+    }
+}
+
+TEST(QLog, BinarySinkRoundTripsThroughDecoder)
+{
+    std::ostringstream text;
+    std::ostringstream binary;
+    QLog::OStreamSink textSink(text);
+    QLog::BinarySink binarySink(binary);
+    {
+        QLog::Logger logger{textSink, QLog::Level::Trace};
+        logger.AddSink(binarySink);
+        const std::string name = "disk \"0\"";
+        for (int i = 0; i < 50; ++i)
+        {
+            logger.LogDeferred(QLog::Level::Info, "%s: %d of %u, %.3f ms, %hhu %c %5.1f|%-4lld|%x %%",
+                               name, -i, 50u, 0.25 * i, static_cast<unsigned char>(200 + i), 'a' + i % 26,
+                               1.5f, static_cast<long long>(i) * -100000000000LL, 0xbeefu);
+            QLOG_DEFERRED(logger, QLog::Level::Warn, "site %d %s", i, "x");
+        }
+        logger.Error("plain %s", "text");
+        logger.EnableTimestamps(false);
+        logger.LogDeferred(QLog::Level::Debug, "no time %*d", 6, 42);
+    }
+
+    std::istringstream in(binary.str());
+    QLog::BinaryLogReader reader(in);
+    ASSERT_TRUE(reader.Valid());
+    std::string decoded;
+    QLog::BinaryRecord record;
+    std::vector<QLog::BinaryRecord> records;
+    while (reader.Next(record))
+    {
+        QLog::Message message;
+        message.level = record.level;
+        message.timestamp = record.timestamp;
+        message.text = record.text;
+        std::string line(QLog::MaxRecordSize(message), '\0');
+        line.resize(QLog::FormatRecord(message, line.data()));
+        decoded += line;
+        records.push_back(record);
+    }
+    EXPECT_FALSE(reader.Corrupt());
+    EXPECT_EQ(decoded, text.str());
+    ASSERT_EQ(records.size(), 102u);
+    // Formats are defined once, so records are far smaller than their text
+    EXPECT_LT(binary.str().size() * 2, text.str().size());
+
+    EXPECT_EQ(QLog::FormatJson(records[1]).substr(0, 6), "{\"ts_n");
+    const auto json = QLog::FormatJson(records[101]);
+    EXPECT_EQ(json, "{\"level\":\"DEBUG\",\"format\":\"no time %*d\",\"args\":[6,42],\"text\":\"no time     42\"}");
+    EXPECT_NE(QLog::FormatJson(records[0]).find("\"args\":[\"disk \\\"0\\\"\",0,50,0,200,97,1.5,0,48879]"),
+              std::string::npos);
+}
+
+TEST(QLog, BinarySinkDefinesReusedFormatAddressesByContent)
+{
+    std::ostringstream binary;
+    QLog::BinarySink sink(binary);
+    {
+        QLog::Logger logger{sink, QLog::Level::Info};
+        // One buffer standing in for a freed format whose address comes back
+        // with other text; each record is written before the buffer changes
+        char format[16];
+        for (const char* text : {"first %d", "second %d", "first %d"})
+        {
+            std::snprintf(format, sizeof(format), "%s", text);
+            logger.LogDeferred(QLog::Level::Info, format, 7);
+            logger.Flush();
+        }
+        const std::string copy = "second %d"; // same text, another address
+        logger.LogDeferred(QLog::Level::Info, copy.c_str(), 8);
+    }
+
+    std::istringstream in(binary.str());
+    QLog::BinaryLogReader reader(in);
+    QLog::BinaryRecord record;
+    std::vector<std::string> texts;
+    while (reader.Next(record))
+    {
+        texts.push_back(record.text);
+    }
+    EXPECT_FALSE(reader.Corrupt());
+    EXPECT_EQ(texts, (std::vector<std::string>{"first 7", "second 7", "first 7", "second 8"}));
+    // Two distinct formats, each defined once
+    const std::string stream = binary.str();
+    size_t definitions = 0;
+    for (size_t at = stream.find("second %d"); at != std::string::npos; at = stream.find("second %d", at + 1))
+    {
+        ++definitions;
+    }
+    EXPECT_EQ(definitions, 1u);
+}
+
+TEST(QLog, BinaryLogReaderRejectsBadInput)
+{
+    std::istringstream notBinary("[2025-01-01 00:00:00.000000] INFO: text\n");
+    QLog::BinaryLogReader reader(notBinary);
+    EXPECT_FALSE(reader.Valid());
+
+    std::ostringstream out;
+    {
+        QLog::BinarySink sink(out);
+        QLog::Logger logger{sink};
+        logger.LogDeferred(QLog::Level::Info, "value %d", 7);
+    }
+    // Dropping the definition leaves a record with an unknown format id
+    std::string bytes = out.str();
+    const auto definition = bytes.find("value %d");
+    ASSERT_NE(definition, std::string::npos);
+    bytes.erase(8, definition + std::strlen("value %d") + 1 + 2 - 8);
+    std::istringstream truncated(bytes);
+    QLog::BinaryLogReader damaged(truncated);
+    ASSERT_TRUE(damaged.Valid());
+    QLog::BinaryRecord record;
+    EXPECT_FALSE(damaged.Next(record));
+    EXPECT_TRUE(damaged.Corrupt());
+}
+
+#if !defined(_WIN32)
+namespace
+{
+    // Listening Unix socket standing in for a log collector
+    struct UnixCollector
+    {
+        explicit UnixCollector(const std::string& path)
+            : path(path)
+        {
+            ::unlink(path.c_str());
+            sockaddr_un addr{};
+            addr.sun_family = AF_UNIX;
+            std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+            listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            EXPECT_EQ(::bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)), 0);
+            EXPECT_EQ(::listen(listener, 4), 0);
+        }
+        ~UnixCollector()
+        {
+            ::close(listener);
+            ::unlink(path.c_str());
+        }
+
+        // Accepts one connection and reads until `marker` arrives or the peer
+        // closes. Gives up after kTimeoutSeconds without a connection or data, so a
+        // regression fails the test instead of hanging the suite.
+        std::string ReadUntil(const std::string& marker)
+        {
+            constexpr int kTimeoutSeconds = 10;
+            pollfd pending{listener, POLLIN, 0};
+            if (::poll(&pending, 1, kTimeoutSeconds * 1000) != 1)
+            {
+                ADD_FAILURE() << "no connection within " << kTimeoutSeconds << " s";
+                return {};
+            }
+            const int conn = ::accept(listener, nullptr, nullptr);
+            timeval timeout{kTimeoutSeconds, 0};
+            EXPECT_EQ(::setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)), 0);
+            std::string data;
+            char buffer[4096];
+            ssize_t n;
+            while (data.find(marker) == std::string::npos && (n = ::read(conn, buffer, sizeof(buffer))) > 0)
+            {
+                data.append(buffer, static_cast<size_t>(n));
+            }
+            EXPECT_NE(data.find(marker), std::string::npos) << "timed out or disconnected before the marker";
+            ::close(conn);
+            return data;
+        }
+
+        // Accepts one connection, takes what has already arrived and hangs up
+        std::string TakeAndClose()
+        {
+            pollfd pending{listener, POLLIN, 0};
+            if (::poll(&pending, 1, 10000) != 1)
+            {
+                ADD_FAILURE() << "no connection within 10 s";
+                return {};
+            }
+            const int conn = ::accept(listener, nullptr, nullptr);
+            std::string data;
+            char buffer[4096];
+            ssize_t n;
+            while ((n = ::recv(conn, buffer, sizeof(buffer), MSG_DONTWAIT)) > 0)
+            {
+                data.append(buffer, static_cast<size_t>(n));
+            }
+            ::close(conn);
+            return data;
+        }
+
+        std::string path;
+        int listener{-1};
+    };
+}
+
+TEST(QLog, NetworkSinkStreamsToUnixSocket)
+{
+    const auto path = (std::filesystem::temp_directory_path() / "qlog_net_test.sock").string();
+    UnixCollector collector(path);
+    std::string received;
+    std::thread reader([&] { received = collector.ReadUntil("INFO: done\n"); });
+
+    QLog::NetworkSinkOptions options;
+    options.flushTimeout = std::chrono::seconds(5);
+    QLog::NetworkSink sink("unix:" + path, options);
+    {
+        QLog::Logger logger{sink};
+        for (int i = 0; i < 2000; ++i)
+        {
+            logger.LogDeferred(QLog::Level::Info, "record %d", i);
+        }
+        logger.Info("done");
+        logger.Flush();
+    }
+    reader.join();
+
+    EXPECT_NE(received.find("] INFO: record 0\n"), std::string::npos);
+    EXPECT_NE(received.find("] INFO: record 1999\n["), std::string::npos);
+    const auto stats = sink.GetStats();
+    EXPECT_EQ(stats.recordsDropped, 0u);
+    EXPECT_EQ(stats.spilledBytes, 0u);
+    EXPECT_EQ(stats.bytesSent, received.size());
+    EXPECT_THROW(QLog::NetworkSink("udp:nowhere"), std::invalid_argument);
+}
+
+TEST(QLog, NetworkSinkSpillsWhileCollectorIsDown)
+{
+    const auto path = (std::filesystem::temp_directory_path() / "qlog_net_spill.sock").string();
+    ::unlink(path.c_str());
+
+    QLog::NetworkSinkOptions options;
+    options.spillCapacity = 32 * 1024;
+    options.reconnectMin = std::chrono::milliseconds(1);
+    options.reconnectMax = std::chrono::milliseconds(2);
+    QLog::NetworkSink sink("unix:" + path, options);
+    QLog::Logger logger{sink};
+
+    // Nobody is listening: logging and flushing must not wait
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 5000; ++i)
+    {
+        logger.Info("spilled %d", i);
+    }
+    logger.Flush();
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(2));
+    auto stats = sink.GetStats();
+    EXPECT_FALSE(stats.connected);
+    EXPECT_GT(stats.recordsDropped, 0u);
+    EXPECT_LE(stats.spilledBytes, options.spillCapacity + 8 * 1024);
+
+    // Once the collector is up the newest records go out on the next write
+    UnixCollector collector(path);
+    std::string received;
+    std::thread reader([&] { received = collector.ReadUntil("INFO: back\n"); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    logger.Info("back");
+    for (int i = 0; i < 5000 && sink.GetStats().spilledBytes != 0; ++i)
+    {
+        logger.Flush();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    logger.Shutdown();
+    reader.join();
+
+    stats = sink.GetStats();
+    EXPECT_EQ(stats.connects, 1u);
+    EXPECT_NE(received.find("] INFO: spilled 4999\n"), std::string::npos);
+    EXPECT_EQ(received.find("] INFO: spilled 0\n"), std::string::npos);
+    EXPECT_EQ(received.substr(0, 1), "[");
+}
+
+TEST(QLog, NetworkSinkDropsTheLineCutOffByADisconnect)
+{
+    const auto path = (std::filesystem::temp_directory_path() / "qlog_net_cut.sock").string();
+    UnixCollector collector(path);
+
+    QLog::NetworkSinkOptions options;
+    options.reconnectMin = std::chrono::milliseconds(1);
+    options.reconnectMax = std::chrono::milliseconds(2);
+    QLog::NetworkSink sink("unix:" + path, options);
+    QLog::Logger logger{sink};
+    logger.EnableTimestamps(false);
+
+    // Far more than the socket buffer holds, so a send stops partway
+    constexpr int kRecords = 400;
+    const std::string payload(3001, 'c');
+    for (int i = 0; i < kRecords; ++i)
+    {
+        logger.Info("r%d %s", i, payload.c_str());
+    }
+    logger.Flush();
+    const std::string first = collector.TakeAndClose();
+    ASSERT_FALSE(first.empty());
+    ASSERT_NE(first.back(), '\n') << "the connection has to drop mid-line";
+    const auto lastLine = first.rfind('\n');
+    int lastDelivered = -1;
+    if (lastLine != std::string::npos)
+    {
+        const auto start = first.rfind('\n', lastLine - 1);
+        ASSERT_EQ(std::sscanf(first.c_str() + (start == std::string::npos ? 0 : start + 1), "INFO: r%d", &lastDelivered), 1);
+    }
+
+    std::string received;
+    std::thread reader([&] { received = collector.ReadUntil("INFO: done\n"); });
+    logger.Info("done");
+    for (int i = 0; i < 5000 && (sink.GetStats().connects < 2 || sink.GetStats().spilledBytes != 0); ++i)
+    {
+        logger.Flush();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    logger.Shutdown();
+    reader.join();
+
+    // The new connection starts at a line boundary, after the cut record
+    std::istringstream lines(received);
+    std::string line;
+    int expected = lastDelivered + 2;
+    while (std::getline(lines, line) && line != "INFO: done")
+    {
+        ASSERT_TRUE(line == "INFO: r" + std::to_string(expected) + " " + payload)
+            << "expected r" << expected << ", got " << line.substr(0, 40);
+        ++expected;
+    }
+    EXPECT_EQ(line, "INFO: done");
+    EXPECT_EQ(expected, kRecords);
+    EXPECT_EQ(sink.GetStats().recordsDropped, 1u);
+}
+#endif
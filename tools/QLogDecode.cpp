@@ -0,0 +1,52 @@
+#include "QLog.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+// Prints the records of a BinarySink file as text lines, or as JSON lines with --json
+int main(int argc, char** argv)
+{
+    const bool json = argc == 3 && std::strcmp(argv[1], "--json") == 0;
+    if (argc != 2 && !json)
+    {
+        std::fprintf(stderr, "usage: %s [--json] <binary-log>\n", argv[0]);
+        return 2;
+    }
+    const char* path = argv[argc - 1];
+
+    std::ifstream in(path, std::ios::binary);
+    QLog::BinaryLogReader reader(in);
+    if (!reader.Valid())
+    {
+        std::fprintf(stderr, "%s: not a QLog binary log\n", path);
+        return 1;
+    }
+    QLog::BinaryRecord record;
+    std::string line;
+    while (reader.Next(record))
+    {
+        if (json)
+        {
+            line = QLog::FormatJson(record);
+            line.push_back('\n');
+        }
+        else
+        {
+            QLog::Message message;
+            message.level = record.level;
+            message.timestamp = record.timestamp;
+            message.text = record.text;
+            line.resize(QLog::MaxRecordSize(message));
+            line.resize(QLog::FormatRecord(message, line.data()));
+        }
+        std::fwrite(line.data(), 1, line.size(), stdout);
+    }
+    if (reader.Corrupt())
+    {
+        std::fprintf(stderr, "%s: stopped at a malformed entry\n", path);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,23 @@
+#include "QLog.h"
+
+#include <cstdio>
+#include <string>
+
+// Prints the records of a MappedRingFileSink file, oldest first
+int main(int argc, char** argv)
+{
+    if (argc != 2)
+    {
+        std::fprintf(stderr, "usage: %s <ring-file>\n", argv[0]);
+        return 2;
+    }
+
+    std::string text;
+    if (!QLog::ReadRingFile(argv[1], text))
+    {
+        std::fprintf(stderr, "%s: not a QLog ring file\n", argv[1]);
+        return 1;
+    }
+    std::fwrite(text.data(), 1, text.size(), stdout);
+    return 0;
+}